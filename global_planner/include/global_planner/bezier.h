@@ -2,6 +2,8 @@
 #define GLOBAL_PLANNER_BEZIER_H_
 
 #include <math.h>  // sqrt
+#include <map>
+#include <vector>
 
 // This file consists functions for functions for Bezier curves
 
@@ -19,17 +21,78 @@ T quadraticBezierAcc(T p0, T p1, T p2, double duration = 1.0) {
   return 2 * (p2 - 2 * p1 + p0) / duration * duration;
 }
 
+// The weights of p0, p1 and p2 at the num_steps + 1 evenly spaced times of a
+// quadratic Bezier curve. Sampling a coordinate is then three multiply-adds per point
+struct BezierBasis {
+  explicit BezierBasis(int num_steps) : w0(num_steps + 1), w1(num_steps + 1), w2(num_steps + 1) {
+    for (int i = 0; i <= num_steps; ++i) {
+      double t = num_steps > 0 ? static_cast<double>(i) / num_steps : 0.0;
+      w0[i] = (1 - t) * (1 - t);
+      w1[i] = 2 * (1 - t) * t;
+      w2[i] = t * t;
+    }
+  }
+  int numPoints() const { return w0.size(); }
+
+  std::vector<double> w0;
+  std::vector<double> w1;
+  std::vector<double> w2;
+};
+
+// Returns the basis for num_steps, each thread keeps the ones it has used
+inline const BezierBasis& getBezierBasis(int num_steps) {
+  thread_local std::map<int, BezierBasis> bases;
+  auto it = bases.find(num_steps);
+  if (it == bases.end()) {
+    it = bases.emplace(num_steps, BezierBasis(num_steps)).first;
+  }
+  return it->second;
+}
+
+// Points of a curve, with one array per coordinate
+struct CurveSamples {
+  void resize(int size) {
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+  }
+  int size() const { return x.size(); }
+
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> z;
+};
+
+// Samples one coordinate of the curve into out, which has basis.numPoints() elements
+inline void sampleBezier(const BezierBasis& basis, double p0, double p1, double p2, double* out) {
+  const double* w0 = basis.w0.data();
+  const double* w1 = basis.w1.data();
+  const double* w2 = basis.w2.data();
+  int num_points = basis.numPoints();
+  for (int i = 0; i < num_points; ++i) {
+    out[i] = w0[i] * p0 + w1[i] * p1 + w2[i] * p2;
+  }
+}
+
+// Fills curve with the quadratic Bezier-curve starting in p0 and ending in p2
+template <typename P>
+void threePointBezier(const P& p0, const P& p1, const P& p2, const BezierBasis& basis, CurveSamples& curve) {
+  curve.resize(basis.numPoints());
+  sampleBezier(basis, p0.x, p1.x, p2.x, curve.x.data());
+  sampleBezier(basis, p0.y, p1.y, p2.y, curve.y.data());
+  sampleBezier(basis, p0.z, p1.z, p2.z, curve.z.data());
+}
+
 // Returns a quadratic Bezier-curve starting in p0 and and ending in p2
 template <typename P>
 std::vector<P> threePointBezier(const P& p0, const P& p1, const P& p2, int num_steps = 10) {
-  std::vector<P> curve;
-  for (int i = 0; i <= num_steps; ++i) {
-    double t = ((double)i) / num_steps;
-    P new_point;
-    new_point.x = quadraticBezier(p0.x, p1.x, p2.x, t);
-    new_point.y = quadraticBezier(p0.y, p1.y, p2.y, t);
-    new_point.z = quadraticBezier(p0.z, p1.z, p2.z, t);
-    curve.push_back(new_point);
+  CurveSamples samples;
+  threePointBezier(p0, p1, p2, getBezierBasis(num_steps), samples);
+  std::vector<P> curve(samples.size());
+  for (int i = 0; i < samples.size(); ++i) {
+    curve[i].x = samples.x[i];
+    curve[i].y = samples.y[i];
+    curve[i].z = samples.z[i];
   }
   return curve;
 }
@@ -41,14 +104,16 @@ nav_msgs::Path threePointBezier(const Path& path, int num_steps = 10) {
     printf("Path size error, %d != 3 \n", static_cast<int>(path.poses.size()));
     return path;
   }
-  auto new_path = path;
-  auto new_points = threePointBezier(new_path.poses[0].pose.position, new_path.poses[1].pose.position,
-                                     new_path.poses[2].pose.position, num_steps);
-  new_path.poses.clear();
-  for (auto point : new_points) {
-    auto new_pose = path.poses[0];
-    new_pose.pose.position = point;
-    new_path.poses.push_back(new_pose);
+  CurveSamples samples;
+  threePointBezier(path.poses[0].pose.position, path.poses[1].pose.position, path.poses[2].pose.position,
+                   getBezierBasis(num_steps), samples);
+  nav_msgs::Path new_path;
+  new_path.header = path.header;
+  new_path.poses.assign(samples.size(), path.poses[0]);
+  for (int i = 0; i < samples.size(); ++i) {
+    new_path.poses[i].pose.position.x = samples.x[i];
+    new_path.poses[i].pose.position.y = samples.y[i];
+    new_path.poses[i].pose.position.z = samples.z[i];
   }
   return new_path;
 }
@@ -1,6 +1,7 @@
 #ifndef GLOBAL_PLANNER_COMMON_H_
 #define GLOBAL_PLANNER_COMMON_H_
 
+#include <algorithm>
 #include <math.h>  // sqrt
 #include <string>
 
@@ -17,6 +18,9 @@ double squared(T x) {
 // start
 inline double interpolate(double start, double end, double ratio) { return start + (end - start) * ratio; }
 
+// Integer division that rounds towards negative infinity
+inline int floorDiv(int a, int b) { return (a >= 0) ? a / b : -((-a + b - 1) / b); }
+
 // Returns Map[key] if it exists, default_val otherwise
 template <typename Key, typename Value, typename Map>
 Value getWithDefault(Map& m, const Key& key, const Value& default_val) {
@@ -92,6 +96,19 @@ double distance(const P& p1, const P& p2) {
   return norm((p2.x - p1.x), (p2.y - p1.y), (p2.z - p1.z));
 }
 
+// Returns the distance from p to the closest point on the line segment between a and b
+template <typename P>
+double distanceToSegment(const P& p, const P& a, const P& b) {
+  P ab = subtractPoints(b, a);
+  double length_sq = squared(ab.x) + squared(ab.y) + squared(ab.z);
+  double ratio = 0.0;
+  if (length_sq > 0.0) {
+    ratio = ((p.x - a.x) * ab.x + (p.y - a.y) * ab.y + (p.z - a.z) * ab.z) / length_sq;
+    ratio = std::min(1.0, std::max(0.0, ratio));
+  }
+  return distance(p, interpolate(a, b, ratio));
+}
+
 inline double clocksToMicroSec(std::clock_t start, std::clock_t end) {
   return (end - start) / (double)(CLOCKS_PER_SEC / 1000000);
 }
@@ -104,6 +121,10 @@ inline double angleToRange(double angle) {
   return angle;
 }
 
+inline double logOdds(double p) { return log(p / (1.0 - p)); }
+
+inline double logOddsToProbability(double log_odds) { return 1.0 / (1.0 + exp(-log_odds)); }
+
 inline double posterior(double p, double prior) {
   // p and prior are independent measurements of the same event
   double prob_obstacle = p * prior;
@@ -0,0 +1,60 @@
+#ifndef GLOBAL_PLANNER_FLAT_MAP_H_
+#define GLOBAL_PLANNER_FLAT_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <octomap/OcTree.h>
+
+namespace global_planner {
+
+struct FlatMapHeader;
+
+// Read-only copy of an OcTree for lookups. The leaves are sorted by the Morton
+// code of their first voxel, so every OcTree node is a contiguous range of
+// leaves and a lookup is a binary search over one array of codes. The values of
+// inner nodes are not stored, the highest log-odds of a range of leaves is
+// found with block maxima of 16, 256, ... leaves.
+// The map is one block of memory without pointers, so it can be written to a
+// file and mapped read-only by several processes without copying it
+class FlatMap {
+ public:
+  FlatMap() = default;
+  ~FlatMap();
+  FlatMap(const FlatMap&) = delete;
+  FlatMap& operator=(const FlatMap&) = delete;
+
+  void build(const octomap::OcTree& tree);
+  bool write(const std::string& filename) const;
+  bool open(const std::string& filename);
+
+  // Same result as OcTree::search(x, y, z, depth)->getValue(), returns false
+  // where the OcTree has no node
+  bool search(double x, double y, double z, int depth, float& log_odds) const;
+
+  bool isValid() const { return header_ != nullptr; }
+  double getResolution() const;
+  size_t size() const;  // Number of leaves
+  size_t memoryUsage() const;
+
+ private:
+  void close();
+  void setSections(const char* data);
+  float maxLogOdds(size_t begin, size_t end) const;
+
+  std::vector<uint64_t> buffer_;  // The data of a map made by build
+  char* mapped_data_ = nullptr;   // The data of a map read by open
+  size_t mapped_size_ = 0;
+
+  const FlatMapHeader* header_ = nullptr;
+  const uint64_t* codes_ = nullptr;     // Morton code of the first voxel of each leaf
+  const float* log_odds_ = nullptr;
+  const uint8_t* depths_ = nullptr;
+  std::vector<const float*> maxima_;    // maxima_[0][i] is the highest log-odds of leaves 16i to 16i + 15
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_FLAT_MAP_H_
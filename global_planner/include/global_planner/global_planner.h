@@ -3,8 +3,11 @@
 
 #include <math.h>     // abs
 #include <algorithm>  // std::reverse
+#include <chrono>     // steady_clock
 #include <limits>     // numeric_limits
+#include <memory>     // std::shared_ptr
 #include <queue>      // std::priority_queue
+#include <sstream>    // std::ostringstream
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -23,15 +26,37 @@
 #include "global_planner/cell.h"
 #include "global_planner/common.h"
 #include "global_planner/common_ros.h"
+#include "global_planner/flat_map.h"
+#include "global_planner/heuristic_field.h"
 #include "global_planner/node.h"
+#include "global_planner/occupied_cells.h"
+#include "global_planner/parallel.h"
+#include "global_planner/planner_stats.h"
 #include "global_planner/search_tools.h"
+#include "global_planner/site_cache.h"
+#include "global_planner/trajectory_history.h"
 #include "global_planner/visitor.h"
 
 namespace global_planner {
 
+// One of the searches that are run concurrently in the portfolio search
+struct PortfolioConfig {
+  std::string node_type;
+  double overestimate_factor;
+  double speednode_radius;
+};
+
+// A precomputed path between two consecutive waypoints of the mission
+struct MissionLeg {
+  GoalCell goal;
+  std::vector<Cell> path;  // Empty if no path was found
+  bool risk_outdated;      // The map has changed since the path was checked
+};
+
 class GlobalPlanner {
  public:
   octomap::OcTree* octree_ = NULL;
+  std::shared_ptr<const FlatMap> flat_map_;  // Copy of octree_ for the risk lookups, if set. Reset when octree_ changes
   // std::vector<double> alt_prior_ {  1.0, 0.1, 0.05, 0.05, 0.05, 0.05, 0.05,
   // 0.05, 0.05, 0.05, 0.05, 0.05}; std::vector<double> alt_prior_ { 0.1, 0.1,
   // 0.1, 0.1, 0.1, 0.1, 0.1,
@@ -40,24 +65,24 @@ class GlobalPlanner {
                                  0.0125, 0.001, 0.001,  0.001, 0.001,  0.001, 0.001, 0.001, 0.001,
                                  0.001,  0.001, 0.001,  0.001, 0.001,  0.001, 0.001};
 
+  std::vector<double> alt_prior_log_odds_;  // alt_prior_ in log-odds, for the posterior in log-space
+
   // Needed to quickly estimate the risk of vertical movement
   std::vector<double> accumulated_alt_prior_;  // accumulated_alt_prior_[i] =
                                                // sum(alt_prior_[0:i])
 
-  std::unordered_map<Cell, double> risk_cache_;         // Cache of getRisk(Cell)
-  std::unordered_map<Cell, double> bubble_risk_cache_;  // Cache the risk of the safest path from Cell to t
-  std::unordered_map<Node, double> heuristic_cache_;    // Cache of
-                                                        // getHeuristic(Node) (and
-                                                        // later reverse search)
-  double bubble_cost_ = 0.0;                            // Minimum risk for the safest path from a cell
-                                                        // outside of the bubble to t
-  double bubble_radius_ = 0.0;                          // The maximum distance from a cell within the bubble to t
+  std::unordered_map<Cell, double> risk_cache_;  // Cache of getRisk(Cell)
+  HeuristicField heuristic_field_;                // Cost to goal found by a backward search from the goal
+  bool heuristic_field_outdated_ = false;         // The map was replaced since the field was computed
+  std::unordered_set<Cell> heuristic_field_changed_cells_;  // Map cells updated since the field was refreshed
+  std::unordered_set<Cell> corridor_;            // Coarse cells the fine search may use, empty means all
+  int corridor_scale_ = 1;                        // Number of cells along each side of a coarse cell
 
-  std::unordered_set<Cell> occupied_;    // Cells which have at some point contained an obstacle point
+  OccupiedCells occupied_;               // Cells which have recently contained an obstacle point
   std::unordered_set<Cell> path_cells_;  // Cells that are on current path, and may not be blocked
 
   // TODO: rename and remove not needed
-  std::vector<Cell> path_back_;
+  TrajectoryHistory path_back_;  // Where the vehicle has been, for goBack
   geometry_msgs::Point curr_pos_;
   double curr_yaw_;
   geometry_msgs::Vector3 curr_vel_;
@@ -67,7 +92,12 @@ class GlobalPlanner {
   double overestimate_factor_ = max_overestimate_factor_;
   std::vector<Cell> curr_path_;
   PathInfo curr_path_info_;
+  GoalCell path_goal_ = GoalCell(0.0, 0.0, 0.0);  // The goal curr_path_ was planned for
+  bool path_is_valid_ = false;                     // curr_path_ was found by a search and is still legal
+  bool path_risk_outdated_ = true;                 // The map has changed since curr_path_ was checked
+  std::vector<MissionLeg> mission_legs_;           // Paths between the upcoming waypoints, planned ahead
   SearchVisitor<std::unordered_set<Cell>, std::unordered_map<Cell, double> > visitor_;
+  PlannerStats stats_;  // Work done since the stats were last reset
 
   // Dynamic reconfigure parameters
   int min_altitude_ = 1;
@@ -91,8 +121,31 @@ class GlobalPlanner {
   bool use_current_yaw_ = true;    // The current orientation is factored into the smoothness
   bool use_risk_heuristics_ = true;
   bool use_speedup_heuristics_ = true;
+  bool use_heuristic_field_ = true;          // Use the backward search from the goal as heuristic
+  bool heuristic_field_3d_ = true;           // If false, the field ignores altitude
+  int heuristic_field_scale_ = 1;            // Cells per side of a field cell, more than 1 is not admissible
+  int heuristic_field_margin_ = 10;          // Number of cells the field extends past the start and goal
+  int heuristic_field_max_cells_ = 1000000;  // Larger fields are not computed
   std::string default_node_type_ = "SpeedNode";
   std::string frame_id_ = "world";
+  bool use_hierarchical_planning_ = false;  // Plan on coarse cells first, then refine around that path
+  int hierarchy_levels_ = 2;                // The coarse cells are 2^hierarchy_levels_ cells wide
+  int corridor_width_ = 1;                  // Number of coarse cells around the coarse path to refine in
+  bool use_any_angle_search_ = false;       // Search with line of sight shortcuts, the path needs no simplifying
+  bool use_bidirectional_search_ = false;   // Search from both ends when smoothness is ignored
+  bool use_bidirectional_threads_ = false;  // Run the two directions of the search on two threads
+  bool use_portfolio_search_ = false;  // Run several search configurations concurrently
+  double portfolio_deadline_ = 0.5;    // Seconds until the unfinished portfolio searches are cancelled
+  int portfolio_threads_ = 0;          // Number of portfolio threads, 0 means one per core
+  bool use_path_watchdog_ = false;     // Only replan when the current path is no longer valid
+  double max_path_deviation_ = 2.0;    // Distance from the current path that triggers a replan
+  bool use_mission_planning_ = false;  // Plan the paths between all the waypoints ahead of time
+  int mission_threads_ = 0;            // Number of threads planning the mission legs, 0 means one per core
+  int risk_query_threads_ = 0;         // Number of threads of the batch risk queries, 0 means one per core
+
+  // Set for the workers of the portfolio search, their risk lookups read from the caches of this planner
+  const GlobalPlanner* shared_planner_ = nullptr;
+  std::chrono::steady_clock::time_point search_deadline_ = std::chrono::steady_clock::time_point::max();
 
   GlobalPlanner();
   ~GlobalPlanner();
@@ -105,26 +158,39 @@ class GlobalPlanner {
   void setFrame(std::string frame_id);
 
   void updateFullOctomap(octomap::AbstractOcTree* tree);
+  void updateOctomapCells(const std::unordered_set<Cell>& changed_cells);
+  void invalidateRisks(const std::unordered_set<Cell>& changed_cells);
+  SiteCacheKey getSiteCacheKey() const;
+  bool saveSiteCache(const std::string& filename);
+  bool loadSiteCache(const std::string& filename);
 
   void getOpenNeighbors(const Cell& cell, std::vector<CellDistancePair>& neighbors, bool is_3D);
   bool isNearWall(const Cell& cell);
 
   double getEdgeDist(const Cell& u, const Cell& v);
   double getSingleCellRisk(const Cell& cell);
+  void getSingleCellRiskTerms(const Cell& cell, double& log_odds, double& scale);
   double getAltPrior(const Cell& cell);
+  double getAltPriorLogOdds(const Cell& cell);
   bool isOccupied(const Cell& cell);
   bool isLegal(const Node& node);
+  bool isInCorridor(const Cell& cell);
+  double getCoarseRisk(const Cell& coarse_cell, int scale);
   double getRisk(const Cell& cell);
   double getRisk(const Node& node);
+  void getRisks(const std::vector<Cell>& cells, std::vector<double>& risks);
   double getRiskOfCurve(const std::vector<geometry_msgs::PoseStamped>& msg);
   double getTurnSmoothness(const Node& u, const Node& v);
+  double getSmoothCost(const Node& u, const Node& v);
   double getEdgeCost(const Node& u, const Node& v);
+  bool isLineOfSight(const Cell& u, const Cell& v);
 
   double riskHeuristic(const Cell& u, const Cell& goal);
-  double riskHeuristicReverseCache(const Cell& u, const Cell& goal);
   double smoothnessHeuristic(const Node& u, const Cell& goal);
   double altitudeHeuristic(const Cell& u, const Cell& goal);
   double getHeuristic(const Node& u, const Cell& goal);
+  HeuristicFieldParameters getHeuristicFieldParameters();
+  void updateHeuristicField(const Cell& start, const GoalCell& goal);
 
   geometry_msgs::PoseStamped createPoseMsg(const Cell& cell, double yaw);
   nav_msgs::Path getPathMsg();
@@ -132,17 +198,36 @@ class GlobalPlanner {
   PathWithRiskMsg getPathWithRiskMsg();
   PathInfo getPathInfo(const std::vector<Cell>& path);
 
-  NodePtr getStartNode(const Cell& start, const Cell& parent, const std::string& type);
+  NodePtr getStartNode(const Cell& start, const Cell& parent, const std::string& type,
+                       double speednode_radius = SPEEDNODE_RADIUS);
   bool findPath(std::vector<Cell>& path);
 
   bool getGlobalPath();
+  bool isCurrentPathValid();
+  bool isPathLegal(const std::vector<Cell>& path, int first_edge);
   void goBack();
   void stop();
   void setRobotRadius(double radius);
 
+  void copySearchParameters(const GlobalPlanner& other);
+  bool isSearchCancelled() const;
+  std::vector<PortfolioConfig> getPortfolioConfigs();
+  bool findPathPortfolio(std::vector<Cell>& path);
+  void setCorridor(const std::vector<Cell>& coarse_path, int scale);
+  bool findPathHierarchical(std::vector<Cell>& path);
+  void planMission(const std::vector<GoalCell>& waypoints);
+  bool useMissionLeg();
+
  private:
   double robot_radius_;
   double octree_resolution_;
+  std::vector<Cell> flow_offsets_;  // getFlowNeighbors of the origin for flow_offsets_radius_
+  int flow_offsets_radius_ = -1;
+
+  bool searchMap(double x, double y, double z, int depth, float& log_odds) const;
+  const double* findCachedRisk(const Cell& cell) const;
+  void updateFlowOffsets();
+  double computeRisk(const Cell& cell);
 };
 
 }  // namespace global_planner
@@ -8,9 +8,11 @@
 #include <set>
 #include <string>
 
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <geometry_msgs/PointStamped.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <mavros_msgs/Trajectory.h>
+#include <message_filters/subscriber.h>
 #include <nav_msgs/Odometry.h>
 #include <nav_msgs/Path.h>
 #include <pcl_conversions/pcl_conversions.h>
@@ -18,7 +20,9 @@
 #include <ros/callback_queue.h>
 #include <ros/ros.h>
 #include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <std_msgs/ColorRGBA.h>
+#include <tf/message_filter.h>
 #include <tf/transform_listener.h>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
@@ -30,6 +34,7 @@
 
 #include "avoidance/avoidance_node.h"
 #include "global_planner/global_planner.h"
+#include "global_planner/occupancy_mapper.h"
 
 #ifndef DISABLE_SIMULATION
 #include <avoidance/rviz_world_loader.h>
@@ -38,7 +43,9 @@
 namespace global_planner {
 
 struct cameraData {
-  ros::Subscriber pointcloud_sub_;
+  // The filter holds back clouds until their transform is available
+  std::unique_ptr<message_filters::Subscriber<sensor_msgs::PointCloud2> > pointcloud_sub_;
+  std::unique_ptr<tf::MessageFilter<sensor_msgs::PointCloud2> > pointcloud_filter_;
 };
 
 class GlobalPlannerNode {
@@ -52,6 +59,12 @@ class GlobalPlannerNode {
 
  private:
   std::mutex mutex_;
+  std::mutex pending_cells_mutex_;  // Protects pending_occupied_cells_ and pending_map_updates_
+
+  // Obstacle cells of each point cloud with its time stamp, waiting to be added to the planner
+  std::vector<std::pair<double, std::vector<Cell> > > pending_occupied_cells_;
+  std::vector<OccupancyUpdate> pending_map_updates_;
+  std::unique_ptr<OccupancyMapper> mapper_;  // Builds the map from the point clouds, if not using /octomap_full
 
   ros::NodeHandle nh_;
   ros::NodeHandle nh_private_;
@@ -77,6 +90,7 @@ class GlobalPlannerNode {
   ros::Publisher mavros_waypoint_publisher_;
   ros::Publisher current_waypoint_publisher_;
   ros::Publisher pointcloud_pub_;
+  ros::Publisher diagnostics_pub_;
 
   ros::Time start_time_;
   ros::Time last_wp_time_;
@@ -100,6 +114,7 @@ class GlobalPlannerNode {
   std::vector<geometry_msgs::PoseStamped> last_clicked_points;
   std::vector<geometry_msgs::PoseStamped> path_;
   std::vector<cameraData> cameras_;
+  PlannerStats total_stats_;  // Work of all the planner loops, printed at shutdown
 
   int num_octomap_msg_ = 0;
   int num_pos_msg_ = 0;
@@ -111,6 +126,9 @@ class GlobalPlannerNode {
   double start_yaw_;
   bool position_received_;
   std::string frame_id_;
+  bool use_flat_map_ = false;
+  std::string flat_map_file_;
+  std::string site_cache_file_;  // Map and risk cache of the site, loaded at startup and saved at shutdown
 
   // Dynamic Reconfiguration
   double clicked_goal_alt_;
@@ -129,6 +147,9 @@ class GlobalPlannerNode {
   void setNewGoal(const GoalCell& goal);
   void popNextGoal();
   void planPath();
+  void planMission();
+  void publishDiagnostics();
+  void printStatsSummary();
   void setIntermediateGoal();
   bool isCloseToGoal();
   void setCurrentPath(const std::vector<geometry_msgs::PoseStamped>& poses);
@@ -138,7 +159,8 @@ class GlobalPlannerNode {
   void clickedPointCallback(const geometry_msgs::PointStamped& msg);
   void moveBaseSimpleCallback(const geometry_msgs::PoseStamped& msg);
   void octomapFullCallback(const octomap_msgs::Octomap& msg);
-  void depthCameraCallback(const sensor_msgs::PointCloud2& msg);
+  void depthCameraCallback(const sensor_msgs::PointCloud2::ConstPtr& msg);
+  void addPendingObservations();
   void fcuInputGoalCallback(const mavros_msgs::Trajectory& msg);
   void cmdLoopCallback(const ros::TimerEvent& event);
   void plannerLoopCallback(const ros::TimerEvent& event);
@@ -0,0 +1,31 @@
+#ifndef GLOBAL_PLANNER_GLOBAL_PLANNER_NODELET_H
+#define GLOBAL_PLANNER_GLOBAL_PLANNER_NODELET_H
+
+#include <memory>
+
+#include <nodelet/nodelet.h>
+
+#include "global_planner/global_planner_node.h"
+
+namespace global_planner {
+
+// Runs the GlobalPlannerNode inside a nodelet manager. Loaded in the same
+// manager as the local planner, both receive the same shared point clouds and
+// poses without serialization
+class GlobalPlannerNodelet : public nodelet::Nodelet {
+ public:
+  GlobalPlannerNodelet() = default;
+  virtual ~GlobalPlannerNodelet() = default;
+
+  /**
+  * @brief     Initializer for nodelets
+  **/
+  virtual void onInit();
+
+ private:
+  std::unique_ptr<GlobalPlannerNode> global_planner_node_;
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_GLOBAL_PLANNER_NODELET_H
@@ -0,0 +1,80 @@
+#ifndef GLOBAL_PLANNER_HEURISTIC_FIELD_H_
+#define GLOBAL_PLANNER_HEURISTIC_FIELD_H_
+
+#include <functional>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <unordered_set>
+#include <vector>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// The parts of the cost model of GlobalPlanner that the field needs
+struct HeuristicFieldParameters {
+  int min_altitude;
+  int max_altitude;
+  int margin;  // Number of cells the box extends past the start and goal
+  int scale;   // Number of cells along x and y in one field cell
+  bool is_3D;  // If false, the altitudes are collapsed into one layer
+  double risk_factor;
+  double up_cost;
+  double down_cost;
+  double max_cell_risk;
+};
+
+// Dense cost-to-goal table for a box around the start and the goal, found by a
+// Dijkstra search backwards from the goal. The edge costs use the lowest risk
+// around each edge, so with scale 1 the costs are lower bounds of the
+// distance, altitude and risk cost of getEdgeCost for unit steps.
+// Cells that can't be entered with a legal unit step block the search.
+class HeuristicField {
+ public:
+  typedef std::function<double(const Cell&)> RiskFunction;
+
+  HeuristicField() = default;
+  ~HeuristicField() = default;
+
+  void compute(const GoalCell& goal, const Cell& start, const HeuristicFieldParameters& params,
+               const RiskFunction& cell_risk);
+  int refresh(const RiskFunction& cell_risk);
+  int refresh(const RiskFunction& cell_risk, const std::unordered_set<Cell>& changed_cells, int radius);
+  void clear();
+
+  bool isValid() const { return !dist_.empty(); }
+  bool covers(const GoalCell& goal, const Cell& start, const HeuristicFieldParameters& params) const;
+  static long numCells(const GoalCell& goal, const Cell& start, const HeuristicFieldParameters& params);
+  double getCostToGoal(const Cell& cell) const;
+  int size() const { return dist_.size(); }
+
+  // Binary copy of the field, read returns false and leaves the field empty if the data is cut off
+  void write(std::ostream& out) const;
+  bool read(std::istream& in);
+
+ private:
+  int index(int i, int j, int k) const { return (k * size_y_ + j) * size_x_ + i; }
+  int fieldIndex(const Cell& cell) const;
+  void computeRisks(const RiskFunction& cell_risk, std::vector<float>& risks) const;
+  float computeRisk(const RiskFunction& cell_risk, int idx) const;
+  int repair(const std::vector<int>& changed);
+  double edgeCost(int from, int to) const;
+  void neighbors(int idx, std::vector<int>& neighbors) const;
+  void propagate(std::vector<std::pair<float, int> >& heap);
+  void computeDistances();
+
+  GoalCell goal_ = GoalCell(0.0, 0.0, 0.0);
+  HeuristicFieldParameters params_;
+  int x0_ = 0, y0_ = 0, z0_ = 0;                // Cell indices of the corner of the box
+  int size_x_ = 0, size_y_ = 0, size_z_ = 0;    // Number of field cells along each axis
+  double step_xy_ = 1.0, step_z_ = 1.0;         // Side lengths of a field cell
+  std::vector<float> risk_;                     // Lowest cell risk in each field cell
+  std::vector<float> dist_;                     // Cost to goal
+  std::vector<int> next_;                       // The next field cell towards the goal, -1 for goal cells
+  std::vector<int> goal_cells_;
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_HEURISTIC_FIELD_H_
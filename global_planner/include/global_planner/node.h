@@ -3,12 +3,15 @@
 
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "global_planner/cell.h"
 #include "global_planner/common.h"
 
 namespace global_planner {
 
+const std::vector<Cell>& getCellOffsets(const Cell& parent, const Cell& cell);
+
 class Node {
  public:
   Node() = default;
@@ -21,6 +24,7 @@ class Node {
   virtual std::shared_ptr<Node> nextNode(const Cell& nextCell) const;
   virtual std::vector<std::shared_ptr<Node> > getNeighbors() const;
   virtual std::unordered_set<Cell> getCells() const;
+  virtual const std::vector<Cell>& getCellOffsets() const;
 
   virtual double getLength() const;
   virtual double getRotation(const Node& other) const;
@@ -73,10 +77,11 @@ static double SPEEDNODE_RADIUS = 5.0;
 class SpeedNode : public Node {
  public:
   SpeedNode() = default;
-  SpeedNode(const Cell& cell, const Cell& parent) : Node(cell, parent) {}
+  SpeedNode(const Cell& cell, const Cell& parent, double radius = SPEEDNODE_RADIUS)
+      : Node(cell, parent), radius_(radius) {}
   ~SpeedNode() = default;
 
-  NodePtr nextNode(const Cell& nextCell) const { return NodePtr(new SpeedNode(nextCell, cell_)); }
+  NodePtr nextNode(const Cell& nextCell) const { return NodePtr(new SpeedNode(nextCell, cell_, radius_)); }
 
   std::vector<NodePtr> getNeighbors() const {
     std::vector<NodePtr> neighbors;
@@ -84,12 +89,65 @@ class SpeedNode : public Node {
     neighbors.push_back(nextNode(extrapolate_cell));
     for (const Cell& neighborCell : extrapolate_cell.getNeighbors()) {
       double dist = cell_.distance3D(neighborCell);
-      if (dist > 0 && dist < SPEEDNODE_RADIUS) {
+      if (dist > 0 && dist < radius_) {
         neighbors.push_back(nextNode(neighborCell));
       }
     }
     return neighbors;
   }
+
+  double radius_ = SPEEDNODE_RADIUS;  // Maximum length of an edge, is passed on to the neighbors
+};
+
+// An edge of the state lattice, from a cell to cell + step
+struct MotionPrimitive {
+  Cell step;
+  std::vector<Cell> swept_offsets;  // Cells covered by the edge, relative to its start
+  double length;
+};
+
+// The motion primitives of a SpeedNode search with the given radius. The
+// velocity of a node is the step of the edge that led to it, the next edge
+// keeps it or changes it by one of the unit steps of Cell::getNeighbors, and
+// must be shorter than radius. The successors of every velocity in the cube of
+// edges shorter than radius are computed once, with the footprints of the edges
+class MotionPrimitiveTable {
+ public:
+  explicit MotionPrimitiveTable(double radius);
+
+  // Returns nullptr if the step is outside the table
+  const MotionPrimitive* getPrimitive(const Cell& step) const;
+  const std::vector<const MotionPrimitive*>* getSuccessors(const Cell& velocity) const;
+  double getRadius() const { return radius_; }
+
+ private:
+  int index(const Cell& step) const;
+
+  double radius_;
+  int max_step_;  // Largest step along an axis
+  int side_;
+  std::vector<MotionPrimitive> primitives_;                       // Indexed by index(step)
+  std::vector<std::vector<const MotionPrimitive*> > successors_;  // Indexed by index(velocity)
+};
+
+// Returns the table for radius, tables are built once and shared by all threads
+const MotionPrimitiveTable& getMotionPrimitives(double radius);
+
+// SpeedNode whose successors and edge footprints are looked up in a
+// MotionPrimitiveTable instead of being computed with every expansion
+class LatticeNode : public Node {
+ public:
+  LatticeNode(const Cell& cell, const Cell& parent, const MotionPrimitiveTable* primitives)
+      : Node(cell, parent), primitives_(primitives), primitive_(primitives->getPrimitive(cell - parent)) {}
+  ~LatticeNode() = default;
+
+  NodePtr nextNode(const Cell& nextCell) const { return NodePtr(new LatticeNode(nextCell, cell_, primitives_)); }
+  std::vector<NodePtr> getNeighbors() const;
+  const std::vector<Cell>& getCellOffsets() const;
+  double getLength() const;
+
+  const MotionPrimitiveTable* primitives_;
+  const MotionPrimitive* primitive_;  // The edge from parent_ to cell_, nullptr if it is not in the table
 };
 
 struct HashNodePtr {
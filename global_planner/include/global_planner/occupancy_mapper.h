@@ -0,0 +1,53 @@
+#ifndef GLOBAL_PLANNER_OCCUPANCY_MAPPER_H_
+#define GLOBAL_PLANNER_OCCUPANCY_MAPPER_H_
+
+#include <unordered_set>
+#include <vector>
+
+#include <octomap/OcTree.h>
+#include <octomap/octomap.h>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// Same meaning as the sensor_model parameters of the octomap server
+struct OccupancyMapperParameters {
+  double resolution = 1.0;
+  double max_range = 9.0;  // Longer rays only clear space up to max_range, 0 means no limit
+  double prob_hit = 0.9;
+  double prob_miss = 0.45;
+  double clamping_min = 0.01;
+  double clamping_max = 0.99;
+  int num_threads = 0;  // 0 means one per core
+};
+
+// The voxels that one point cloud observed as free and as occupied
+struct OccupancyUpdate {
+  std::vector<octomap::OcTreeKey> free_keys;
+  std::vector<octomap::OcTreeKey> occupied_keys;
+};
+
+// Builds the OcTree of the planner from point clouds, without an octomap
+// server in between. The rays are cast on several threads and don't touch the
+// tree, so that can happen while the planner searches. Only applyUpdate needs
+// exclusive access to the tree
+class OccupancyMapper {
+ public:
+  explicit OccupancyMapper(const OccupancyMapperParameters& params);
+  ~OccupancyMapper() = default;
+
+  octomap::OcTree* createTree() const;
+  void configureTree(octomap::OcTree* tree) const;
+  void computeUpdate(const octomap::Pointcloud& points, const octomap::point3d& origin,
+                     OccupancyUpdate& update) const;
+  void applyUpdate(const OccupancyUpdate& update, octomap::OcTree* tree, std::unordered_set<Cell>& changed_cells) const;
+
+ private:
+  OccupancyMapperParameters params_;
+  octomap::OcTree key_tree_;  // Empty, the keys of a ray only depend on the resolution
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_OCCUPANCY_MAPPER_H_
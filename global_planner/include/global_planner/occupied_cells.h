@@ -0,0 +1,42 @@
+#ifndef GLOBAL_PLANNER_OCCUPIED_CELLS_H_
+#define GLOBAL_PLANNER_OCCUPIED_CELLS_H_
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// Cells which have at some point contained an obstacle point, with the time
+// they were last seen. Cells that haven't been seen for decay_time are
+// forgotten, and the least recently seen cells are dropped when there are more
+// than max_cells, so the store doesn't grow during long missions
+class OccupiedCells {
+ public:
+  OccupiedCells() = default;
+  ~OccupiedCells() = default;
+
+  void setLimits(int max_cells, double decay_time);
+  void insert(const Cell& cell, double stamp);
+  void insert(const std::vector<Cell>& cells, double stamp);
+  void insert(const std::vector<Cell>& cells, double stamp, std::unordered_set<Cell>& changed_cells);
+  void clear();
+
+  bool contains(const Cell& cell) const { return last_seen_.find(cell) != last_seen_.end(); }
+  int size() const { return last_seen_.size(); }
+
+ private:
+  void insertBatch(const std::vector<Cell>& cells, double stamp, std::unordered_set<Cell>* changed_cells);
+  void prune(double stamp, std::unordered_set<Cell>* removed_cells);
+
+  std::unordered_map<Cell, double> last_seen_;
+  int max_cells_ = 500000;
+  double decay_time_ = 60.0;  // In seconds, 0 means that cells are never forgotten
+  double last_prune_ = 0.0;
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_OCCUPIED_CELLS_H_
@@ -0,0 +1,52 @@
+#ifndef GLOBAL_PLANNER_PARALLEL_H_
+#define GLOBAL_PLANNER_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// This file consists of small helpers to spread planner work over several cores
+
+namespace global_planner {
+
+// Returns the number of threads to use, requested_threads <= 0 means one per core
+inline int numWorkerThreads(int requested_threads) {
+  if (requested_threads > 0) {
+    return requested_threads;
+  }
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// Calls func(i) for every i in [0, num_tasks) using up to num_threads threads
+// Tasks are handed out one at a time, so long and short tasks can be mixed.
+// The calling thread also works and the function returns when all tasks are done
+template <typename Func>
+void parallelFor(int num_tasks, int num_threads, const Func& func) {
+  num_threads = std::min(num_threads, num_tasks);
+  if (num_threads <= 1) {
+    for (int i = 0; i < num_tasks; ++i) {
+      func(i);
+    }
+    return;
+  }
+
+  std::atomic<int> next_task(0);
+  auto worker = [&]() {
+    for (int i = next_task++; i < num_tasks; i = next_task++) {
+      func(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace global_planner
+
+#endif /* GLOBAL_PLANNER_PARALLEL_H_ */
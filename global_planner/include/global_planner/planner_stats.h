@@ -0,0 +1,60 @@
+#ifndef GLOBAL_PLANNER_PLANNER_STATS_H_
+#define GLOBAL_PLANNER_PLANNER_STATS_H_
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace global_planner {
+
+// Number, total and longest duration of the runs of one planning phase
+struct PhaseTiming {
+  long count = 0;
+  double total_ms = 0.0;
+  double max_ms = 0.0;
+
+  void add(double ms);
+  void merge(const PhaseTiming& other);
+};
+
+// Counters of the work done by the planner, to see why some plans take much
+// longer than others. Each planner counts its own work, the workers of the
+// concurrent searches are merged into the planner that started them
+struct PlannerStats {
+  long risk_cache_hits = 0;
+  long risk_cache_misses = 0;
+  long heuristic_evaluations = 0;
+  long searches = 0;
+  long expansions = 0;
+  long max_open_set_size = 0;
+  std::map<std::string, PhaseTiming> phases;
+
+  void addPhase(const std::string& phase, double ms) { phases[phase].add(ms); }
+  void addSearch(int num_expansions, int open_set_size);
+  void merge(const PlannerStats& other);
+  double riskCacheHitRate() const;
+  std::vector<std::pair<std::string, double> > values() const;
+};
+
+// Adds the time from its construction to its destruction to a phase of stats
+class ScopedPhaseTimer {
+ public:
+  ScopedPhaseTimer(PlannerStats& stats, const std::string& phase)
+      : stats_(stats), phase_(phase), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedPhaseTimer() {
+    stats_.addPhase(phase_, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count());
+  }
+
+ private:
+  PlannerStats& stats_;
+  std::string phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+long heapAllocatedBytes();
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_PLANNER_STATS_H_
@@ -1,7 +1,10 @@
 #ifndef GLOBAL_PLANNER_SEARCH_TOOLS_H_
 #define GLOBAL_PLANNER_SEARCH_TOOLS_H_
 
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "global_planner/bezier.h"
 #include "global_planner/cell.h"
@@ -21,12 +24,13 @@ struct PathInfo {
 };
 
 struct SearchInfo {
-  SearchInfo() : found_path(false), num_iter(0), search_time(0.0) {}
-  SearchInfo(bool found_path_, int num_iter_, double search_time_)
-      : found_path(found_path_), num_iter(num_iter_), search_time(search_time_) {}
+  SearchInfo() : found_path(false), num_iter(0), search_time(0.0), max_open_size(0) {}
+  SearchInfo(bool found_path_, int num_iter_, double search_time_, int max_open_size_ = 0)
+      : found_path(found_path_), num_iter(num_iter_), search_time(search_time_), max_open_size(max_open_size_) {}
   bool found_path;
   int num_iter;
   double search_time;  // in micro seconds
+  int max_open_size;   // Largest number of entries in the priority queue
 };
 
 inline void printSearchInfo(SearchInfo info, std::string node_type = "Node", double overestimate_factor = 1.0) {
@@ -42,27 +46,30 @@ inline nav_msgs::Path smoothPath(const nav_msgs::Path& path) {
     return path;
   }
 
+  const BezierBasis& basis = getBezierBasis(10);
+  int turn_size = basis.numPoints();
   nav_msgs::Path smooth_path;
   smooth_path.header = path.header;
 
   // Repeat the first and last points to get the first half of the first edge
-  // and the second half of the last edge
-  smooth_path.poses.push_back((path.poses.front()));
+  // and the second half of the last edge. The poses copy the header info of
+  // the first pose, only their positions are filled in below
+  smooth_path.poses.assign(2 + (path.poses.size() - 2) * turn_size, path.poses.front());
+  CurveSamples smooth_turn;
   for (int i = 2; i < path.poses.size(); i++) {
-    geometry_msgs::Point p0 = path.poses[i - 2].pose.position;
-    geometry_msgs::Point p1 = path.poses[i - 1].pose.position;
-    geometry_msgs::Point p2 = path.poses[i].pose.position;
-    p0 = middlePoint(p0, p1);
-    p2 = middlePoint(p1, p2);
-
-    std::vector<geometry_msgs::Point> smooth_turn = threePointBezier(p0, p1, p2);
-    for (const auto& point : smooth_turn) {
-      geometry_msgs::PoseStamped pose_msg = path.poses.front();  // Copy the original header info
-      pose_msg.pose.position = point;
-      smooth_path.poses.push_back(pose_msg);
+    const geometry_msgs::Point& p1 = path.poses[i - 1].pose.position;
+    geometry_msgs::Point p0 = middlePoint(path.poses[i - 2].pose.position, p1);
+    geometry_msgs::Point p2 = middlePoint(p1, path.poses[i].pose.position);
+
+    threePointBezier(p0, p1, p2, basis, smooth_turn);
+    geometry_msgs::PoseStamped* turn_poses = &smooth_path.poses[1 + (i - 2) * turn_size];
+    for (int j = 0; j < turn_size; ++j) {
+      turn_poses[j].pose.position.x = smooth_turn.x[j];
+      turn_poses[j].pose.position.y = smooth_turn.y[j];
+      turn_poses[j].pose.position.z = smooth_turn.z[j];
     }
   }
-  smooth_path.poses.push_back((path.poses.back()));
+  smooth_path.poses.back() = path.poses.back();
   return smooth_path;
 }
 
@@ -139,9 +146,11 @@ inline SearchInfo findSmoothPath(GlobalPlanner* global_planner, std::vector<Cell
   pq.push(std::make_pair(s, 0.0));
   distance[s] = 0.0;
   int num_iter = 0;
+  int max_open_size = 0;
 
   std::clock_t start_time = std::clock();
-  while (!pq.empty() && num_iter < max_iterations) {
+  while (!pq.empty() && num_iter < max_iterations && !global_planner->isSearchCancelled()) {
+    max_open_size = std::max(max_open_size, static_cast<int>(pq.size()));
     PointerNodeDistancePair u_node_dist = pq.top();
     pq.pop();
     NodePtr u = u_node_dist.first;
@@ -179,7 +188,7 @@ inline SearchInfo findSmoothPath(GlobalPlanner* global_planner, std::vector<Cell
   double average_iter_time = total_time / num_iter;
 
   if (best_goal_node == nullptr || !t.withinPlanRadius(best_goal_node->cell_)) {
-    return SearchInfo(false, num_iter, total_time);  // No path found
+    return SearchInfo(false, num_iter, total_time, max_open_size);  // No path found
   }
 
   // Get the path by walking from t back to s (excluding s)
@@ -197,7 +206,289 @@ inline SearchInfo findSmoothPath(GlobalPlanner* global_planner, std::vector<Cell
   // itDistSquared: %.3f", num_iter, num_iter / squared(path.size())); printf("
   // %2.1f µs \t\t %d \t\t %2.2f \t", average_iter_time, num_iter,
   // distance[best_goal_node]);
-  return SearchInfo(true, num_iter, total_time);
+  return SearchInfo(true, num_iter, total_time, max_open_size);
+}
+
+// One direction of the bidirectional search
+struct SearchFrontier {
+  std::unordered_map<Cell, double> distance;
+  std::unordered_map<Cell, Cell> parent;  // The next cell towards the root of this direction
+  std::unordered_set<Cell> closed;
+  std::priority_queue<CellDistancePair, std::vector<CellDistancePair>, CompareDist> pq;
+
+  // Lower bound of the f-value of all open cells, stale queue entries only make it smaller
+  double minF() const { return pq.empty() ? INFINITY : pq.top().second; }
+};
+
+// Bidirectional A* for the NodeWithoutSmooth cost model, where the cost of an
+// edge only depends on its two cells. The forward search grows from s, the
+// backward search from all cells within the plan radius of t, and the directions
+// meet in the cell with the lowest sum of distances. The search stops when that
+// sum is no larger than the smallest f-value in one of the directions. The
+// distance term of the heuristic is scaled by overestimate_factor_, so if the
+// unscaled heuristic is admissible the path costs at most overestimate_factor_
+// times the optimal cost, and is optimal only for a factor of 1. With
+// use_two_threads each direction runs on its own thread, both read the caches
+// of global_planner but cache new risks separately
+template <typename GlobalPlanner>
+SearchInfo findSmoothPathBidirectional(GlobalPlanner* global_planner, std::vector<Cell>& path, const Cell& s,
+                                       const Cell& parent_of_s, const GoalCell& t, int max_iterations,
+                                       bool use_two_threads = false) {
+  SearchFrontier forward;
+  SearchFrontier backward;
+  std::mutex frontier_mutex;  // Protects the frontiers and the meeting point
+  double best_cost = INFINITY;
+  Cell meeting_cell = s;
+  bool done = false;
+  int num_iter = 0;
+  int max_open_size = 0;
+  double factor = global_planner->overestimate_factor_;
+
+  forward.distance[s] = 0.0;
+  forward.pq.push(std::make_pair(s, 0.0));
+  int goal_steps = std::ceil(t.radius_ / 2.0 / CELL_SCALE);
+  for (int dx = -goal_steps; dx <= goal_steps; ++dx) {
+    for (int dy = -goal_steps; dy <= goal_steps; ++dy) {
+      for (int dz = -goal_steps; dz <= goal_steps; ++dz) {
+        Cell goal_cell(std::tuple<int, int, int>(t.xIndex() + dx, t.yIndex() + dy, t.zIndex() + dz));
+        if (t.withinPlanRadius(goal_cell)) {
+          backward.distance[goal_cell] = 0.0;
+          backward.pq.push(std::make_pair(goal_cell, 0.0));
+        }
+      }
+    }
+  }
+  if (backward.distance.find(s) != backward.distance.end()) {
+    best_cost = 0.0;
+  }
+
+  // The heuristics of getHeuristic that don't depend on the parent. The
+  // backward search estimates the cost from s instead of the cost to t
+  auto estimate = [&](GlobalPlanner* planner, const Cell& u, bool is_forward) {
+    const Cell& end = is_forward ? static_cast<const Cell&>(t) : s;
+    double heuristic = factor * u.diagDistance2D(end);
+    heuristic += is_forward ? planner->altitudeHeuristic(u, t) : planner->altitudeHeuristic(s, u);
+    if (planner->use_risk_heuristics_) {
+      heuristic += planner->riskHeuristic(u, end);
+    }
+    return heuristic;
+  };
+
+  // Expands one cell in the given direction, returns false when the search is over
+  auto expand = [&](GlobalPlanner* planner, bool is_forward) {
+    SearchFrontier& self = is_forward ? forward : backward;
+    SearchFrontier& other = is_forward ? backward : forward;
+    Cell u;
+    double u_dist;
+    {
+      std::lock_guard<std::mutex> lock(frontier_mutex);
+      while (!self.pq.empty() && self.closed.find(self.pq.top().first) != self.closed.end()) {
+        self.pq.pop();
+      }
+      if (done || best_cost <= std::max(forward.minF(), backward.minF()) || num_iter >= max_iterations ||
+          planner->isSearchCancelled()) {
+        done = true;
+        return false;
+      }
+      // u stays in the queue until it is expanded, so the other direction sees its f-value
+      u = self.pq.top().first;
+      u_dist = self.distance[u];
+      num_iter++;
+    }
+
+    // Edge costs and heuristics are evaluated without holding the lock
+    std::vector<std::tuple<Cell, double, double> > relaxed;  // (cell, distance, f-value)
+    for (const Cell& v : u.getNeighbors()) {
+      // The edge goes from u to v when searching forward, and from v to u when searching backward
+      const Cell& from = is_forward ? u : v;
+      const Cell& to = is_forward ? v : u;
+      NodeWithoutSmooth edge(to, from);
+      if (!planner->isLegal(edge)) {
+        continue;
+      }
+      double new_dist = u_dist + planner->getEdgeCost(NodeWithoutSmooth(from, from), edge);
+      relaxed.push_back(std::make_tuple(v, new_dist, new_dist + estimate(planner, v, is_forward)));
+    }
+
+    std::lock_guard<std::mutex> lock(frontier_mutex);
+    self.pq.pop();
+    self.closed.insert(u);
+    for (const auto& v_dist : relaxed) {
+      const Cell& v = std::get<0>(v_dist);
+      double new_dist = std::get<1>(v_dist);
+      if (new_dist >= getWithDefault(self.distance, v, INFINITY)) {
+        continue;
+      }
+      self.distance[v] = new_dist;
+      self.parent[v] = u;
+      self.pq.push(std::make_pair(v, std::get<2>(v_dist)));
+      auto other_dist = other.distance.find(v);
+      if (other_dist != other.distance.end() && new_dist + other_dist->second < best_cost) {
+        // The directions meet in v
+        best_cost = new_dist + other_dist->second;
+        meeting_cell = v;
+      }
+    }
+    max_open_size = std::max(max_open_size, static_cast<int>(forward.pq.size() + backward.pq.size()));
+    return true;
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+  if (use_two_threads) {
+    GlobalPlanner forward_planner;
+    GlobalPlanner backward_planner;
+    for (GlobalPlanner* planner : {&forward_planner, &backward_planner}) {
+      planner->copySearchParameters(*global_planner);
+      // A mission worker only has a copy of the parameters, the caches and occupied_ are in its shared planner
+      planner->shared_planner_ = global_planner->shared_planner_ ? global_planner->shared_planner_ : global_planner;
+    }
+    std::thread backward_thread([&]() {
+      while (expand(&backward_planner, false)) {
+      }
+    });
+    while (expand(&forward_planner, true)) {
+    }
+    backward_thread.join();
+    for (GlobalPlanner* planner : {&forward_planner, &backward_planner}) {
+      global_planner->risk_cache_.insert(planner->risk_cache_.begin(), planner->risk_cache_.end());
+      global_planner->stats_.merge(planner->stats_);
+    }
+  } else {
+    // Expand the direction with the smaller frontier
+    while (expand(global_planner, forward.pq.size() <= backward.pq.size())) {
+    }
+  }
+  double total_time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+
+  if (best_cost == INFINITY) {
+    return SearchInfo(false, num_iter, total_time, max_open_size);  // No path found
+  }
+
+  // Walk from the meeting cell back to s, then forward to the goal region
+  for (Cell walker = meeting_cell; walker != s; walker = forward.parent[walker]) {
+    path.push_back(walker);
+  }
+  path.push_back(s);
+  path.push_back(parent_of_s);
+  std::reverse(path.begin(), path.end());
+  for (Cell walker = meeting_cell; backward.parent.find(walker) != backward.parent.end();) {
+    walker = backward.parent[walker];
+    path.push_back(walker);
+  }
+  return SearchInfo(true, num_iter, total_time, max_open_size);
+}
+
+// Lazy Theta*: an A* where a cell takes the parent of the cell that reached it
+// as its own parent, so the path is made of straight lines between its
+// vertices. A new cell gets an estimate of the cost of the line from the
+// parent, the line of sight and its exact cost are only checked when the cell
+// is expanded. If the line is blocked or costs more, the cell is connected to
+// its best expanded neighbor instead
+template <typename GlobalPlanner, typename Visitor>
+SearchInfo findAnyAnglePath(GlobalPlanner* global_planner, std::vector<Cell>& path, const Cell& s,
+                            const Cell& parent_of_s, const GoalCell& t, int max_iterations, Visitor& visitor) {
+  visitor.init();
+  std::unordered_map<Cell, double> distance;
+  std::unordered_map<Cell, double> line_risk;  // Risk of the line from the parent
+  std::unordered_map<Cell, Cell> parent;
+  std::unordered_set<Cell> closed;
+  std::priority_queue<CellDistancePair, std::vector<CellDistancePair>, CompareDist> pq;
+  distance[s] = 0.0;
+  line_risk[s] = 0.0;
+  parent[s] = parent_of_s;
+  pq.push(std::make_pair(s, 0.0));
+  Cell best_goal_cell = s;
+  bool found_path = false;
+  int num_iter = 0;
+  int max_open_size = 0;
+
+  // The cost of reaching v with a line from u as in getEdgeCost, infinite if the line is blocked
+  auto line_cost = [&](const Cell& u, const Cell& v, double& risk) -> double {
+    if (!global_planner->isLineOfSight(u, v)) {
+      return INFINITY;
+    }
+    Node v_node(v, u);
+    risk = global_planner->getRisk(v_node);
+    return distance[u] + global_planner->getEdgeDist(u, v) + global_planner->risk_factor_ * risk +
+           global_planner->getSmoothCost(Node(u, parent[u]), v_node);
+  };
+
+  std::clock_t start_time = std::clock();
+  while (!pq.empty() && num_iter < max_iterations && !global_planner->isSearchCancelled()) {
+    max_open_size = std::max(max_open_size, static_cast<int>(pq.size()));
+    Cell u = pq.top().first;
+    pq.pop();
+    if (closed.find(u) != closed.end()) {
+      continue;
+    }
+
+    if (u != s) {
+      // Check the line from the parent, and the steps from the expanded neighbors
+      double risk = 0.0;
+      Cell best_parent = parent[u];
+      double best_dist = line_cost(best_parent, u, risk);
+      double best_risk = risk;
+      for (const Cell& n : u.getNeighbors()) {
+        if (n == parent[u] || closed.find(n) == closed.end()) {
+          continue;
+        }
+        double new_dist = line_cost(n, u, risk);
+        if (new_dist < best_dist) {
+          best_dist = new_dist;
+          best_parent = n;
+          best_risk = risk;
+        }
+      }
+      if (best_dist == INFINITY) {
+        continue;  // Can't reach u from any expanded cell
+      }
+      distance[u] = best_dist;
+      parent[u] = best_parent;
+      line_risk[u] = best_risk;
+    }
+    closed.insert(u);
+    visitor.popNode(NodePtr(new Node(u, parent[u])));
+
+    if (t.withinPlanRadius(u)) {
+      best_goal_cell = u;
+      found_path = true;
+      break;  // Found a path
+    }
+    num_iter++;
+
+    // A line from the parent of u to v is cheaper to estimate than to check
+    const Cell& p = u == s ? s : parent[u];
+    for (const Cell& v : u.getNeighbors()) {
+      if (closed.find(v) != closed.end() || !global_planner->isLegal(Node(v, u))) {
+        continue;
+      }
+      double new_risk = line_risk[u] + global_planner->getRisk(v) * u.distance3D(v);
+      Node v_node(v, p);
+      double new_dist = distance[p] + global_planner->getEdgeDist(p, v) + global_planner->risk_factor_ * new_risk +
+                        global_planner->getSmoothCost(Node(p, parent[p]), v_node);
+      if (new_dist < getWithDefault(distance, v, INFINITY)) {
+        distance[v] = new_dist;
+        parent[v] = p;
+        line_risk[v] = new_risk;
+        pq.push(std::make_pair(v, new_dist + global_planner->getHeuristic(v_node, t)));
+        visitor.perNeighbor(NodePtr(new Node(u, parent[u])), NodePtr(new Node(v_node)));
+      }
+    }
+  }
+  double total_time = clocksToMicroSec(start_time, std::clock());
+
+  if (!found_path) {
+    return SearchInfo(false, num_iter, total_time, max_open_size);  // No path found
+  }
+
+  // Get the path by walking from the goal back to s, only the corners are on the path
+  for (Cell walker = best_goal_cell; walker != s; walker = parent[walker]) {
+    path.push_back(walker);
+  }
+  path.push_back(s);
+  path.push_back(parent_of_s);
+  std::reverse(path.begin(), path.end());
+  return SearchInfo(true, num_iter, total_time, max_open_size);
 }
 
 // Searches for a path from s to t at max_altitude_, fills path if it finds one
@@ -226,39 +517,90 @@ bool find2DPath(GlobalPlanner* global_planner, std::vector<Cell>& path, const Ce
   return false;
 }
 
-// TODO: Run search backwards to quickly find impossible scenarios and/or find
-// exact heuristics for nodes close to goal
+// A* over blocks of scale^3 cells, fills coarse_path with the block indices
+// from the block of s to the block of t. A block is illegal if its riskiest
+// cell is, the blocks of s and t are always legal. Unexplored blocks are legal,
+// so the search stays in a box around s and t, with a margin as wide as their
+// distance plus corridor_width_, and stops after max_iterations_ blocks
 template <typename GlobalPlanner>
-bool reverseSearch(GlobalPlanner* global_planner, const Cell& t) {
-  std::map<Cell, double> cost;
+bool findCoarsePath(GlobalPlanner* global_planner, std::vector<Cell>& coarse_path, const Cell& s, const Cell& t,
+                    int scale) {
+  auto toCoarse = [scale](const Cell& cell) {
+    return Cell(std::tuple<int, int, int>(floorDiv(cell.xIndex(), scale), floorDiv(cell.yIndex(), scale),
+                                          floorDiv(cell.zIndex(), scale)));
+  };
+  Cell coarse_s = toCoarse(s);
+  Cell coarse_t = toCoarse(t);
+  int min_z = floorDiv(global_planner->min_altitude_, scale);
+  int max_z = floorDiv(global_planner->max_altitude_, scale);
+  double edge_length = CELL_SCALE * scale;
+  if (coarse_t.zIndex() < min_z || coarse_t.zIndex() > max_z) {
+    return false;
+  }
+  int margin = global_planner->corridor_width_ + std::max(std::abs(coarse_t.xIndex() - coarse_s.xIndex()),
+                                                          std::abs(coarse_t.yIndex() - coarse_s.yIndex()));
+  int min_x = std::min(coarse_s.xIndex(), coarse_t.xIndex()) - margin;
+  int max_x = std::max(coarse_s.xIndex(), coarse_t.xIndex()) + margin;
+  int min_y = std::min(coarse_s.yIndex(), coarse_t.yIndex()) - margin;
+  int max_y = std::max(coarse_s.yIndex(), coarse_t.yIndex()) + margin;
+
+  std::unordered_set<Cell> seen;
+  std::unordered_map<Cell, Cell> parent;
+  std::unordered_map<Cell, double> distance;
+  std::unordered_map<Cell, double> risk_cache;
   std::priority_queue<CellDistancePair, std::vector<CellDistancePair>, CompareDist> pq;
-  std::unordered_set<Cell> seen_cells;
+  pq.push(std::make_pair(coarse_s, 0.0));
+  distance[coarse_s] = 0.0;
   int num_iter = 0;
-  cost[t] = global_planner->getRisk(t);
-  pq.push(std::make_pair(t, cost[t]));
 
-  while (!pq.empty() && num_iter++ < 100) {
-    CellDistancePair u_cell_dist = pq.top();
+  while (!pq.empty() && num_iter < global_planner->max_iterations_) {
+    Cell u = pq.top().first;
     pq.pop();
-    Cell u = u_cell_dist.first;
-    if (seen_cells.find(u) != seen_cells.end()) {
+    if (seen.find(u) != seen.end()) {
       continue;
     }
-    seen_cells.insert(u);
-    global_planner->bubble_risk_cache_[u] = cost[u];
-    global_planner->bubble_cost_ = cost[u];
-    global_planner->bubble_radius_ = std::max(global_planner->bubble_radius_, u.distance3D(t));
+    seen.insert(u);
+    num_iter++;
+    if (u == coarse_t) {
+      break;
+    }
 
     for (const Cell& v : u.getNeighbors()) {
-      double new_cost = cost[u] + u.distance3D(v) * global_planner->risk_factor_ * global_planner->getRisk(v);
-      double old_cost = getWithDefault(cost, v, INFINITY);
-      if (new_cost < old_cost) {
-        cost[v] = new_cost;
-        pq.push(std::make_pair(v, new_cost));
+      if (v.zIndex() < min_z || v.zIndex() > max_z || v.xIndex() < min_x || v.xIndex() > max_x ||
+          v.yIndex() < min_y || v.yIndex() > max_y) {
+        continue;
+      }
+      if (risk_cache.find(v) == risk_cache.end()) {
+        risk_cache[v] = global_planner->getCoarseRisk(v, scale);
+      }
+      double risk = risk_cache[v];
+      if (risk >= global_planner->max_cell_risk_ && v != coarse_t) {
+        continue;
+      }
+      // The same cost model as getEdgeCost, scaled to the size of the blocks
+      int climb = v.zIndex() - u.zIndex();
+      double climb_cost = climb > 0 ? global_planner->up_cost_ * climb : -global_planner->down_cost_ * climb;
+      double dist_cost = edge_length * (u.distance2D(v) / CELL_SCALE + climb_cost);
+      double risk_cost = edge_length * u.distance3D(v) / CELL_SCALE * global_planner->risk_factor_ * risk;
+      double new_dist = distance[u] + dist_cost + risk_cost;
+      if (new_dist < getWithDefault(distance, v, INFINITY)) {
+        parent[v] = u;
+        distance[v] = new_dist;
+        double heuristic = edge_length * v.diagDistance2D(coarse_t) / CELL_SCALE;
+        pq.push(std::make_pair(v, new_dist + heuristic));
       }
     }
   }
-  // TODO: return?
+
+  if (seen.find(coarse_t) == seen.end()) {
+    return false;
+  }
+  for (Cell walker = coarse_t; walker != coarse_s; walker = parent[walker]) {
+    coarse_path.push_back(walker);
+  }
+  coarse_path.push_back(coarse_s);
+  std::reverse(coarse_path.begin(), coarse_path.end());
+  return true;
 }
 
 // A* to find a path from s to t, true iff it found a path
@@ -0,0 +1,74 @@
+#ifndef GLOBAL_PLANNER_SITE_CACHE_H_
+#define GLOBAL_PLANNER_SITE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace global_planner {
+
+// The parameters the cached risks were computed with, the risks of a file are
+// only used if they match the planner that loads it
+struct SiteCacheKey {
+  double robot_radius;
+  double octree_resolution;
+  double cell_scale;
+  double neighbor_risk_flow;
+  double explore_penalty;
+  double alt_prior_sum;  // Changes with the altitude prior
+};
+
+bool operator==(const SiteCacheKey& lhs, const SiteCacheKey& rhs);
+
+// One entry of the risk cache
+struct RiskRecord {
+  double risk;
+  int32_t x;
+  int32_t y;
+  int32_t z;
+  int32_t padding;
+};
+
+struct SiteCacheHeader;
+
+// Writes a site cache file: a header, then the octree, the risk records and
+// the heuristic field, each 8-byte aligned so the records can be read in place.
+// The file is written next to filename, synced to disk and renamed, so after a
+// crash filename is either the old or the new file. Returns false if the file
+// could not be written
+bool writeSiteCacheFile(const std::string& filename, const SiteCacheKey& key, const std::string& octree,
+                        const std::vector<RiskRecord>& risks, const std::string& heuristic_field);
+
+// Read-only view of a site cache file, the file is memory-mapped so opening
+// it doesn't read the sections that are not used
+class SiteCacheFile {
+ public:
+  SiteCacheFile() = default;
+  ~SiteCacheFile();
+  SiteCacheFile(const SiteCacheFile&) = delete;
+  SiteCacheFile& operator=(const SiteCacheFile&) = delete;
+
+  // Returns false if the file doesn't exist or is not a complete site cache.
+  // A file that was open before is closed
+  bool open(const std::string& filename);
+  void close();
+
+  const SiteCacheKey& key() const;
+  const char* octreeData() const;
+  size_t octreeSize() const;
+  const RiskRecord* risks() const;
+  size_t numRisks() const;
+  const char* heuristicFieldData() const;
+  size_t heuristicFieldSize() const;
+
+ private:
+  const SiteCacheHeader& header() const;
+
+  char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_SITE_CACHE_H_
@@ -0,0 +1,64 @@
+#ifndef GLOBAL_PLANNER_TRAJECTORY_HISTORY_H_
+#define GLOBAL_PLANNER_TRAJECTORY_HISTORY_H_
+
+#include <deque>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// The cells the vehicle has been in, oldest first. Straight stretches are
+// stored as runs of cells with the same step, so a long flight needs a few
+// runs per turn instead of one entry per cell. Only the last max_cells cells
+// are kept, the oldest are dropped as new cells are added
+class TrajectoryHistory {
+ public:
+  // Cells first, first + step, ..., first + (length - 1) * step
+  struct Run {
+    Cell first;
+    Cell step;
+    int length;
+    Cell cell(int i) const;
+  };
+
+  // Walks the cells from the newest to the oldest
+  class ReverseIterator {
+   public:
+    ReverseIterator(const std::deque<Run>& runs, int run, int offset) : runs_(&runs), run_(run), offset_(offset) {}
+    Cell operator*() const { return (*runs_)[run_].cell(offset_); }
+    ReverseIterator& operator++();
+    bool operator!=(const ReverseIterator& other) const { return run_ != other.run_ || offset_ != other.offset_; }
+
+   private:
+    const std::deque<Run>* runs_;
+    int run_;
+    int offset_;
+  };
+
+  TrajectoryHistory() = default;
+  ~TrajectoryHistory() = default;
+
+  void setMaxSize(int max_cells);
+  void push_back(const Cell& cell);
+  void popBack(int num_cells);
+  void clear();
+
+  Cell back() const { return runs_.back().cell(runs_.back().length - 1); }
+  bool empty() const { return size_ == 0; }
+  int size() const { return size_; }
+  int numRuns() const { return runs_.size(); }
+
+  ReverseIterator rbegin() const;
+  ReverseIterator rend() const { return ReverseIterator(runs_, -1, 0); }
+
+ private:
+  void popFront();
+
+  std::deque<Run> runs_;
+  int size_ = 0;
+  int max_cells_ = 100000;
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_TRAJECTORY_HISTORY_H_
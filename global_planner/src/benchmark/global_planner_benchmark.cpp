@@ -0,0 +1,256 @@
+// Benchmark of the search functions of the global planner on generated maps.
+// It runs without a ROS master, the maps are built directly as OcTrees.
+//
+// Usage: global_planner_benchmark [scenario] [seed]
+//   scenario: random_boxes, city, mock_wall or all (default)
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <ros/console.h>
+
+#include "global_planner/global_planner.h"
+
+namespace global_planner {
+
+// Counts the cells expanded by findPathOld and find2DPath, which don't return
+// a SearchInfo. The search functions are templates, so they call this method
+// instead of the one of GlobalPlanner
+class CountingPlanner : public GlobalPlanner {
+ public:
+  long num_expansions_ = 0;
+
+  void getOpenNeighbors(const Cell& cell, std::vector<CellDistancePair>& neighbors, bool is_3D) {
+    ++num_expansions_;
+    GlobalPlanner::getOpenNeighbors(cell, neighbors, is_3D);
+  }
+};
+
+struct Scenario {
+  std::string name;
+  octomap::OcTree* tree;
+  std::vector<Cell> obstacles;
+  Cell start;
+  GoalCell goal;
+};
+
+struct BenchmarkResult {
+  std::string scenario;
+  std::string search;
+  bool found_path;
+  long num_expansions;
+  double time_ms;
+  double path_cost;
+  double heap_delta_mb;    // Heap the search left allocated, mostly the risk cache
+  double process_peak_mb;  // Peak resident size of the process so far, not of this search
+};
+
+const float kFreeLogOdds = -2.0f;
+const float kOccupiedLogOdds = 3.5f;
+
+const double kBytesPerMB = 1024.0 * 1024.0;
+
+double processPeakMB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;  // ru_maxrss is in KiB
+}
+
+// Marks the box as explored free space
+void addFreeSpace(octomap::OcTree* tree, int min_x, int max_x, int min_y, int max_y, int max_z) {
+  for (int x = min_x; x < max_x; ++x) {
+    for (int y = min_y; y < max_y; ++y) {
+      for (int z = 0; z < max_z; ++z) {
+        tree->setNodeValue(x + 0.5, y + 0.5, z + 0.5, kFreeLogOdds, true);
+      }
+    }
+  }
+}
+
+void addObstacle(Scenario& scenario, int x, int y, int z) {
+  scenario.tree->setNodeValue(x + 0.5, y + 0.5, z + 0.5, kOccupiedLogOdds, true);
+  scenario.obstacles.push_back(Cell(x + 0.5, y + 0.5, z + 0.5));
+}
+
+// Boxes of random size and height scattered between start and goal
+Scenario createRandomBoxes(unsigned seed) {
+  Scenario scenario{"random_boxes", new octomap::OcTree(1.0), {}, Cell(0.5, 0.5, 3.5), GoalCell(90.5, 5.5, 3.5)};
+  addFreeSpace(scenario.tree, -10, 100, -40, 40, 12);
+  srand(seed);
+  for (int i = 0; i < 40; ++i) {
+    int corner_x = rand() % 85 + 3;
+    int corner_y = rand() % 60 - 30;
+    int width = 2 + rand() % 5;
+    int height = rand() % 12;
+    for (int x = corner_x; x < corner_x + width; ++x) {
+      for (int y = corner_y; y < corner_y + width; ++y) {
+        for (int z = 0; z <= height; ++z) {
+          addObstacle(scenario, x, y, z);
+        }
+      }
+    }
+  }
+  return scenario;
+}
+
+// Blocks of 20m x 20m with a house in the middle of each, like the tiles of
+// the test_city_*.world simulation worlds. The streets are at x, y = 10 + 20k
+Scenario createCity(unsigned seed) {
+  Scenario scenario{"city", new octomap::OcTree(1.0), {}, Cell(-49.5, -49.5, 3.5), GoalCell(50.5, 50.5, 3.5)};
+  addFreeSpace(scenario.tree, -70, 70, -70, 70, 12);
+  srand(seed);
+  for (int block_x = -3; block_x <= 3; ++block_x) {
+    for (int block_y = -3; block_y <= 3; ++block_y) {
+      int half_size = 4 + rand() % 3;
+      int height = 4 + rand() % 10;
+      for (int x = 20 * block_x - half_size; x < 20 * block_x + half_size; ++x) {
+        for (int y = 20 * block_y - half_size; y < 20 * block_y + half_size; ++y) {
+          for (int z = 0; z <= height; ++z) {
+            addObstacle(scenario, x, y, z);
+          }
+        }
+      }
+    }
+  }
+  return scenario;
+}
+
+// The wall and clicked goal of mock_data_node, at the default altitude of clicked goals
+Scenario createMockWall() {
+  Scenario scenario{"mock_wall", new octomap::OcTree(1.0), {}, Cell(0.5, 0.5, 3.5), GoalCell(8.5, 4.5, 3.5)};
+  addFreeSpace(scenario.tree, -10, 20, -15, 15, 12);
+  for (int y = -5; y <= 5; ++y) {
+    for (int z = 0; z <= 6; ++z) {
+      addObstacle(scenario, 5, y, z);
+    }
+  }
+  return scenario;
+}
+
+// Clears the caches of the planner and sets the start and goal of the scenario
+void resetPlanner(CountingPlanner& planner, const Scenario& scenario) {
+  planner.risk_cache_.clear();
+  planner.heuristic_field_.clear();
+  planner.num_expansions_ = 0;
+  planner.overestimate_factor_ = 1.25;
+  planner.max_iterations_ = 200000;
+  geometry_msgs::PoseStamped pose;
+  pose.pose.position = scenario.start.toPoint();
+  planner.setPose(pose);
+  planner.setGoal(scenario.goal);
+}
+
+template <typename Func>
+BenchmarkResult runBenchmark(CountingPlanner& planner, const Scenario& scenario, const std::string& search,
+                             const Func& func) {
+  resetPlanner(planner, scenario);
+  std::vector<Cell> path;
+  long heap_before = heapAllocatedBytes();
+  auto start_time = std::chrono::steady_clock::now();
+  long num_expansions = 0;
+  bool found_path = func(path, num_expansions);
+  auto end_time = std::chrono::steady_clock::now();
+  long heap_after = heapAllocatedBytes();
+  // find2DPath repeats the cells where its parts meet, zero length edges have no cost
+  path.erase(std::unique(path.begin(), path.end()), path.end());
+  double path_cost = found_path ? planner.getPathInfo(path).cost : NAN;
+  return BenchmarkResult{scenario.name,
+                         search,
+                         found_path,
+                         num_expansions,
+                         std::chrono::duration<double, std::milli>(end_time - start_time).count(),
+                         path_cost,
+                         heap_before >= 0 ? (heap_after - heap_before) / kBytesPerMB : NAN,
+                         processPeakMB()};
+}
+
+void benchmarkScenario(Scenario& scenario, std::vector<BenchmarkResult>& results) {
+  CountingPlanner planner;
+  planner.setRobotRadius(0.5);
+  scenario.tree->updateInnerOccupancy();
+  planner.updateFullOctomap(scenario.tree);
+  planner.occupied_.insert(scenario.obstacles, 0.0);
+  const Cell& s = scenario.start;
+  const GoalCell& t = scenario.goal;
+
+  for (const std::string& node_type : {"Node", "NodeWithoutSmooth", "SpeedNode", "LatticeNode"}) {
+    results.push_back(
+        runBenchmark(planner, scenario, "findSmoothPath " + node_type, [&](std::vector<Cell>& path, long& expansions) {
+          SearchInfo info = findSmoothPath(&planner, path, planner.getStartNode(s, s, node_type), t,
+                                           planner.max_iterations_);
+          expansions = info.num_iter;
+          return info.found_path;
+        }));
+  }
+  results.push_back(runBenchmark(planner, scenario, "findPathOld", [&](std::vector<Cell>& path, long& expansions) {
+    bool found_path = findPathOld(&planner, path, s, t, s, true);
+    expansions = planner.num_expansions_;
+    return found_path;
+  }));
+  results.push_back(runBenchmark(planner, scenario, "find2DPath", [&](std::vector<Cell>& path, long& expansions) {
+    bool found_path = find2DPath(&planner, path, s, t, s, planner.max_altitude_);
+    expansions = planner.num_expansions_;
+    return found_path;
+  }));
+
+  // simplifyPath of the path that the node would publish
+  resetPlanner(planner, scenario);
+  std::vector<Cell> search_path;
+  findSmoothPath(&planner, search_path, planner.getStartNode(s, s, "SpeedNode"), t, planner.max_iterations_);
+  results.push_back(runBenchmark(planner, scenario, "simplifyPath", [&](std::vector<Cell>& path, long& expansions) {
+    path = simplifyPath(&planner, search_path, 1.01, 100, false);
+    expansions = search_path.size();  // Number of input vertices
+    return path.size() > 1;
+  }));
+  delete scenario.tree;
+}
+
+void printResults(const std::vector<BenchmarkResult>& results) {
+  printf("\n%-14s %-34s %-6s %10s %10s %12s %10s %10s %13s %15s\n", "scenario", "search", "found", "expansions",
+         "time_ms", "expansions/s", "ns/exp", "path_cost", "heap_delta_MB", "process_peak_MB");
+  for (const BenchmarkResult& result : results) {
+    double per_second = result.time_ms > 0.0 ? 1000.0 * result.num_expansions / result.time_ms : 0.0;
+    double ns_per_expansion = result.num_expansions > 0 ? 1e6 * result.time_ms / result.num_expansions : 0.0;
+    printf("%-14s %-34s %-6s %10ld %10.2f %12.0f %10.0f %10.2f %13.2f %15.1f\n", result.scenario.c_str(),
+           result.search.c_str(), result.found_path ? "yes" : "no", result.num_expansions, result.time_ms, per_second,
+           ns_per_expansion, result.path_cost, result.heap_delta_mb, result.process_peak_mb);
+  }
+}
+
+}  // namespace global_planner
+
+int main(int argc, char** argv) {
+  using namespace global_planner;
+  std::string selected = argc > 1 ? argv[1] : "all";
+  unsigned seed = argc > 2 ? std::atoi(argv[2]) : 3;
+
+  // The searches log every planning step
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  std::vector<BenchmarkResult> results;
+  if (selected == "all" || selected == "random_boxes") {
+    Scenario scenario = createRandomBoxes(seed);
+    benchmarkScenario(scenario, results);
+  }
+  if (selected == "all" || selected == "city") {
+    Scenario scenario = createCity(seed);
+    benchmarkScenario(scenario, results);
+  }
+  if (selected == "all" || selected == "mock_wall") {
+    Scenario scenario = createMockWall();
+    benchmarkScenario(scenario, results);
+  }
+  if (results.empty()) {
+    fprintf(stderr, "Unknown scenario %s, use random_boxes, city, mock_wall or all\n", selected.c_str());
+    return 1;
+  }
+  printResults(results);
+  return 0;
+}
@@ -0,0 +1,262 @@
+#include "global_planner/flat_map.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace global_planner {
+
+namespace {
+const char kMagic[8] = {'G', 'P', 'F', 'L', 'A', 'T', '0', '1'};
+const int kTreeDepth = 16;      // Depth of the leaves of the finest resolution
+const int kTreeMaxVal = 32768;  // Key of the coordinate 0
+const size_t kFanout = 16;      // Number of entries of a level that one entry of the level above covers
+const int kMaxLevels = 12;
+
+uint64_t alignedSize(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+// Spreads the 16 bits of a key to every third bit
+uint64_t spreadBits(uint64_t v) {
+  v &= 0xffff;
+  v = (v | (v << 16)) & 0x0000ff0000ffull;
+  v = (v | (v << 8)) & 0x00f00f00f00full;
+  v = (v | (v << 4)) & 0x0c30c30c30c3ull;
+  v = (v | (v << 2)) & 0x249249249249ull;
+  return v;
+}
+
+uint64_t mortonCode(unsigned x, unsigned y, unsigned z) {
+  return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+// Number of bits of the Morton codes of the voxels in one node at depth
+int codeShift(int depth) { return 3 * (kTreeDepth - depth); }
+}  // namespace
+
+struct FlatMapHeader {
+  char magic[8];
+  double resolution;
+  uint64_t total_size;
+  uint64_t num_leaves;
+  uint64_t num_levels;
+  uint64_t codes_offset;
+  uint64_t log_odds_offset;
+  uint64_t depths_offset;
+  uint64_t level_offsets[kMaxLevels];
+  uint64_t level_sizes[kMaxLevels];
+};
+
+FlatMap::~FlatMap() { close(); }
+
+void FlatMap::close() {
+  if (mapped_data_) {
+    munmap(mapped_data_, mapped_size_);
+    mapped_data_ = nullptr;
+    mapped_size_ = 0;
+  }
+  buffer_.clear();
+  header_ = nullptr;
+  maxima_.clear();
+}
+
+// Copies the leaves of tree. search matches OcTree::search where the inner
+// nodes of tree hold the highest log-odds of their children, as after updateInnerOccupancy
+void FlatMap::build(const octomap::OcTree& tree) {
+  struct Leaf {
+    uint64_t code;
+    float log_odds;
+    uint8_t depth;
+    bool operator<(const Leaf& other) const { return code < other.code; }
+  };
+  std::vector<Leaf> leaves;
+  for (auto it = tree.begin_leafs(), end = tree.end_leafs(); it != end; ++it) {
+    int shift = kTreeDepth - it.getDepth();
+    const octomap::OcTreeKey& key = it.getKey();
+    uint64_t code = mortonCode((key[0] >> shift) << shift, (key[1] >> shift) << shift, (key[2] >> shift) << shift);
+    leaves.push_back(Leaf{code, it->getLogOdds(), static_cast<uint8_t>(it.getDepth())});
+  }
+  std::sort(leaves.begin(), leaves.end());
+
+  FlatMapHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.resolution = tree.getResolution();
+  header.num_leaves = leaves.size();
+  header.codes_offset = alignedSize(sizeof(header));
+  header.log_odds_offset = alignedSize(header.codes_offset + leaves.size() * sizeof(uint64_t));
+  header.depths_offset = alignedSize(header.log_odds_offset + leaves.size() * sizeof(float));
+  uint64_t offset = alignedSize(header.depths_offset + leaves.size());
+  for (size_t level_size = leaves.size(); level_size >= kFanout && header.num_levels < kMaxLevels;) {
+    level_size = (level_size + kFanout - 1) / kFanout;
+    header.level_offsets[header.num_levels] = offset;
+    header.level_sizes[header.num_levels] = level_size;
+    offset = alignedSize(offset + level_size * sizeof(float));
+    ++header.num_levels;
+  }
+  header.total_size = offset;
+
+  close();
+  buffer_.assign(header.total_size / sizeof(uint64_t), 0);
+  char* data = reinterpret_cast<char*>(buffer_.data());
+  std::memcpy(data, &header, sizeof(header));
+  uint64_t* codes = reinterpret_cast<uint64_t*>(data + header.codes_offset);
+  float* log_odds = reinterpret_cast<float*>(data + header.log_odds_offset);
+  uint8_t* depths = reinterpret_cast<uint8_t*>(data + header.depths_offset);
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    codes[i] = leaves[i].code;
+    log_odds[i] = leaves[i].log_odds;
+    depths[i] = leaves[i].depth;
+  }
+  const float* below = log_odds;
+  size_t below_size = leaves.size();
+  for (uint64_t level = 0; level < header.num_levels; ++level) {
+    float* maxima = reinterpret_cast<float*>(data + header.level_offsets[level]);
+    for (size_t i = 0; i < header.level_sizes[level]; ++i) {
+      maxima[i] = *std::max_element(below + i * kFanout, below + std::min(below_size, (i + 1) * kFanout));
+    }
+    below = maxima;
+    below_size = header.level_sizes[level];
+  }
+  setSections(data);
+}
+
+// Writes the map next to filename and renames it, so processes that have the
+// old file mapped keep reading a complete map
+bool FlatMap::write(const std::string& filename) const {
+  if (!header_) {
+    return false;
+  }
+  std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(header_), header_->total_size);
+    if (!out) {
+      std::remove(tmp_filename.c_str());
+      return false;
+    }
+  }
+  return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+}
+
+// Maps a file written by write, the pages are shared with every other process
+// that maps it. Returns false if the file is not a complete map
+bool FlatMap::open(const std::string& filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(FlatMapHeader))) {
+    ::close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);  // The mapping stays valid
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  mapped_data_ = static_cast<char*>(data);
+  mapped_size_ = file_stat.st_size;
+
+  const FlatMapHeader& header = *reinterpret_cast<const FlatMapHeader*>(mapped_data_);
+  bool complete = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.total_size <= mapped_size_ &&
+                  header.num_levels <= kMaxLevels && header.depths_offset + header.num_leaves <= mapped_size_;
+  for (uint64_t level = 0; complete && level < header.num_levels; ++level) {
+    complete = header.level_offsets[level] + header.level_sizes[level] * sizeof(float) <= mapped_size_;
+  }
+  if (!complete) {
+    close();
+    return false;
+  }
+  setSections(mapped_data_);
+  return true;
+}
+
+void FlatMap::setSections(const char* data) {
+  header_ = reinterpret_cast<const FlatMapHeader*>(data);
+  codes_ = reinterpret_cast<const uint64_t*>(data + header_->codes_offset);
+  log_odds_ = reinterpret_cast<const float*>(data + header_->log_odds_offset);
+  depths_ = reinterpret_cast<const uint8_t*>(data + header_->depths_offset);
+  maxima_.clear();
+  for (uint64_t level = 0; level < header_->num_levels; ++level) {
+    maxima_.push_back(reinterpret_cast<const float*>(data + header_->level_offsets[level]));
+  }
+}
+
+double FlatMap::getResolution() const { return header_ ? header_->resolution : 0.0; }
+size_t FlatMap::size() const { return header_ ? header_->num_leaves : 0; }
+size_t FlatMap::memoryUsage() const { return header_ ? header_->total_size : 0; }
+
+// Highest log-odds of the leaves begin to end - 1. The ends of the range are
+// read from the leaves, the middle from the block maxima
+float FlatMap::maxLogOdds(size_t begin, size_t end) const {
+  float result = -std::numeric_limits<float>::infinity();
+  const float* values = log_odds_;
+  for (size_t level = 0; begin < end; ++level) {
+    while (begin < end && begin % kFanout != 0) {
+      result = std::max(result, values[begin++]);
+    }
+    while (begin < end && end % kFanout != 0) {
+      result = std::max(result, values[--end]);
+    }
+    if (begin == end) {
+      break;
+    }
+    begin /= kFanout;
+    end /= kFanout;
+    values = maxima_[level];
+  }
+  return result;
+}
+
+bool FlatMap::search(double x, double y, double z, int depth, float& log_odds) const {
+  if (!header_ || header_->num_leaves == 0) {
+    return false;
+  }
+  double resolution_factor = 1.0 / header_->resolution;
+  unsigned key[3];
+  const double coords[3] = {x, y, z};
+  for (int i = 0; i < 3; ++i) {
+    int scaled = static_cast<int>(std::floor(resolution_factor * coords[i]));
+    if (scaled < -kTreeMaxVal || scaled >= kTreeMaxVal) {
+      return false;
+    }
+    key[i] = scaled + kTreeMaxVal;
+  }
+  if (depth <= 0 || depth > kTreeDepth) {
+    depth = kTreeDepth;
+  }
+
+  // The voxels of the node at depth are the codes first to last
+  int shift = codeShift(depth);
+  uint64_t first = (mortonCode(key[0], key[1], key[2]) >> shift) << shift;
+  uint64_t last = first | ((uint64_t(1) << shift) - 1);
+  const uint64_t* codes_end = codes_ + header_->num_leaves;
+  const uint64_t* after_first = std::upper_bound(codes_, codes_end, first);
+  if (after_first != codes_) {
+    // A pruned leaf that contains the whole node
+    size_t leaf = after_first - codes_ - 1;
+    int leaf_shift = codeShift(depths_[leaf]);
+    if (depths_[leaf] <= depth && (codes_[leaf] >> leaf_shift) == (first >> leaf_shift)) {
+      log_odds = log_odds_[leaf];
+      return true;
+    }
+  }
+  // Otherwise the node is an inner node with the highest log-odds of its leaves
+  size_t begin = (after_first != codes_ && after_first[-1] == first) ? after_first - codes_ - 1 : after_first - codes_;
+  size_t end = std::upper_bound(after_first, codes_end, last) - codes_;
+  if (begin == end) {
+    return false;
+  }
+  log_odds = maxLogOdds(begin, end);
+  return true;
+}
+
+}  // namespace global_planner
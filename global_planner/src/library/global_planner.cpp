@@ -18,11 +18,15 @@ GlobalPlanner::~GlobalPlanner() {}
 
 // Fills accumulated_alt_prior_ such that accumulated_alt_prior_[i] =
 // sum(alt_prior_[0:i]) Used to get the pior risk of vertical movement
+// Also fills alt_prior_log_odds_ with the priors in log-odds
 void GlobalPlanner::calculateAccumulatedHeightPrior() {
   double sum = 0.0;
+  accumulated_alt_prior_.clear();
+  alt_prior_log_odds_.clear();
   for (double p : alt_prior_) {
     sum += p;
     accumulated_alt_prior_.push_back(sum);
+    alt_prior_log_odds_.push_back(logOdds(p));
   }
 }
 
@@ -43,20 +47,18 @@ void GlobalPlanner::setGoal(const GoalCell& goal) {
   goal_pos_ = goal;
   going_back_ = false;
   goal_is_blocked_ = false;
-  heuristic_cache_.clear();
-  bubble_risk_cache_.clear();
 }
 
 // Sets path to be the current path
 void GlobalPlanner::setPath(const std::vector<Cell>& path) {
   curr_path_info_ = getPathInfo(path);
   curr_path_ = path;
+  path_is_valid_ = false;
 
   path_cells_.clear();
   for (int i = 2; i < path.size(); ++i) {
-    Node node(path[i], path[i - 1]);
-    for (const Cell& cell : node.getCells()) {
-      path_cells_.insert(cell);
+    for (const Cell& offset : getCellOffsets(path[i - 1], path[i])) {
+      path_cells_.insert(path[i - 1] + offset);
     }
   }
 }
@@ -73,6 +75,129 @@ void GlobalPlanner::updateFullOctomap(octomap::AbstractOcTree* tree) {
   }
   octree_ = dynamic_cast<octomap::OcTree*>(tree);
   octree_resolution_ = octree_->getResolution();
+  flat_map_.reset();
+  heuristic_field_outdated_ = true;
+  path_risk_outdated_ = true;
+  for (MissionLeg& leg : mission_legs_) {
+    leg.risk_outdated = true;
+  }
+}
+
+// Invalidates the cached risks that depend on changed_cells after octree_ was
+// updated in place, instead of clearing the whole cache like updateFullOctomap
+void GlobalPlanner::updateOctomapCells(const std::unordered_set<Cell>& changed_cells) {
+  if (changed_cells.empty()) {
+    return;
+  }
+  octree_resolution_ = octree_->getResolution();
+  flat_map_.reset();  // It doesn't have the changes
+  invalidateRisks(changed_cells);
+}
+
+// Erases the cached risks that read the risk terms of changed_cells, i.e. their
+// octomap log-odds or whether they are in occupied_, and marks the heuristic
+// field, the current path and the mission legs to be checked again
+void GlobalPlanner::invalidateRisks(const std::unordered_set<Cell>& changed_cells) {
+  if (changed_cells.empty() || !octree_) {
+    return;  // Without a map the risk doesn't read the cells
+  }
+  int radius = static_cast<int>(std::ceil(robot_radius_ / octree_resolution_));
+  std::vector<Cell> flow_offsets = Cell(std::tuple<int, int, int>(0, 0, 0)).getFlowNeighbors(radius);
+  if (changed_cells.size() * flow_offsets.size() > risk_cache_.size()) {
+    risk_cache_.clear();  // Most of the cache would be erased anyway
+  } else {
+    // The risk of a cell includes the risk of its flow neighbors
+    for (const Cell& cell : changed_cells) {
+      for (const Cell& offset : flow_offsets) {
+        risk_cache_.erase(cell + offset);
+      }
+    }
+  }
+  // The field only evaluates the risks around the changed cells again, unless
+  // so many changed that evaluating all of them is cheaper
+  if (!heuristic_field_outdated_ && heuristic_field_.isValid()) {
+    heuristic_field_changed_cells_.insert(changed_cells.begin(), changed_cells.end());
+    if (heuristic_field_changed_cells_.size() > heuristic_field_.size()) {
+      heuristic_field_outdated_ = true;
+      heuristic_field_changed_cells_.clear();
+    }
+  }
+  path_risk_outdated_ = true;
+  for (MissionLeg& leg : mission_legs_) {
+    leg.risk_outdated = true;
+  }
+}
+
+// The parameters of the cost model that the cached risks depend on
+SiteCacheKey GlobalPlanner::getSiteCacheKey() const {
+  return SiteCacheKey{robot_radius_, octree_resolution_, CELL_SCALE, neighbor_risk_flow_, expore_penalty_,
+                      accumulated_alt_prior_.back()};
+}
+
+// Writes the map, the risk cache and the heuristic field to filename, so that
+// the next mission over the same site can start with them. Returns false if
+// there is no map yet or the file could not be written
+bool GlobalPlanner::saveSiteCache(const std::string& filename) {
+  if (!octree_) {
+    return false;
+  }
+  std::ostringstream octree_data;
+  octree_->write(octree_data);
+  std::vector<RiskRecord> risks;
+  risks.reserve(risk_cache_.size());
+  for (const auto& cell_risk : risk_cache_) {
+    const Cell& cell = cell_risk.first;
+    risks.push_back(RiskRecord{cell_risk.second, cell.xIndex(), cell.yIndex(), cell.zIndex(), 0});
+  }
+  std::ostringstream field_data;
+  if (heuristic_field_.isValid()) {
+    heuristic_field_.write(field_data);
+  }
+  return writeSiteCacheFile(filename, getSiteCacheKey(), octree_data.str(), risks, field_data.str());
+}
+
+// Reads a section of a mapped file without copying it into a string first
+class MemoryBuffer : public std::streambuf {
+ public:
+  MemoryBuffer(const char* data, size_t size) {
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+};
+
+// Replaces the map with the one of a file written by saveSiteCache. The cached
+// risks and the heuristic field of the file are only used if they were computed
+// with the same cost model. Returns false if the file has no readable map
+bool GlobalPlanner::loadSiteCache(const std::string& filename) {
+  SiteCacheFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+  MemoryBuffer octree_buffer(file.octreeData(), file.octreeSize());
+  std::istream octree_stream(&octree_buffer);
+  octomap::AbstractOcTree* tree = octomap::AbstractOcTree::read(octree_stream);
+  if (!dynamic_cast<octomap::OcTree*>(tree)) {
+    delete tree;
+    return false;
+  }
+  updateFullOctomap(tree);  // Clears the risk cache, so the cached risks are inserted after it
+  if (!(file.key() == getSiteCacheKey())) {
+    ROS_INFO("Loaded the map of %s, its risks were computed with different parameters", filename.c_str());
+    return true;
+  }
+
+  const RiskRecord* risks = file.risks();
+  risk_cache_.reserve(file.numRisks());
+  for (size_t i = 0; i < file.numRisks(); ++i) {
+    risk_cache_.emplace(Cell(std::tuple<int, int, int>(risks[i].x, risks[i].y, risks[i].z)), risks[i].risk);
+  }
+  if (file.heuristicFieldSize() > 0) {
+    MemoryBuffer field_buffer(file.heuristicFieldData(), file.heuristicFieldSize());
+    std::istream field_stream(&field_buffer);
+    heuristic_field_.read(field_stream);  // Refreshed with the risks of the map before it is used
+  }
+  ROS_INFO("Loaded the map of %s with %d cached risks", filename.c_str(), (int)risk_cache_.size());
+  return true;
 }
 
 // TODO: simplify and return neighbors
@@ -131,33 +256,47 @@ double GlobalPlanner::getEdgeDist(const Cell& u, const Cell& v) {
 
 // Risk without looking at the neighbors
 double GlobalPlanner::getSingleCellRisk(const Cell& cell) {
+  double log_odds, scale;
+  getSingleCellRiskTerms(cell, log_odds, scale);
+  return scale * logOddsToProbability(log_odds);
+}
+
+// Log-odds of the map node that contains the point at depth, from the flat
+// copy of the map if there is one. Returns false for unexplored space
+bool GlobalPlanner::searchMap(double x, double y, double z, int depth, float& log_odds) const {
+  if (flat_map_) {
+    return flat_map_->search(x, y, z, depth, log_odds);
+  }
+  octomap::OcTreeNode* node = octree_->search(x, y, z, depth);
+  if (!node) {
+    return false;
+  }
+  log_odds = node->getValue();
+  return true;
+}
+
+// The risk of a cell is scale * logOddsToProbability(log_odds). The posterior
+// of the octomap measurement and the altitude prior is found in log-space, as
+// the sum of their log-odds. scale is the explore penalty of cells that have
+// never been seen to contain an obstacle
+void GlobalPlanner::getSingleCellRiskTerms(const Cell& cell, double& log_odds, double& scale) {
   if (cell.zIndex() < 1 || !octree_) {
-    return 1.0;  // Octomap does not keep track of the ground
+    log_odds = INFINITY;  // Octomap does not keep track of the ground
+    scale = 1.0;
+    return;
   }
-  // octomap::OcTreeNode* node = octree_->search(cell.xPos(), cell.yPos(),
-  // cell.zPos());
   int octree_depth = std::min(16, 17 - int(CELL_SCALE + 0.1));
-  octomap::OcTreeNode* node = octree_->search(cell.xPos(), cell.yPos(), cell.zPos(), octree_depth);
-  if (node) {
-    // TODO: posterior in log-space
-    double log_odds = node->getValue();
-    // double parentLogOdds = parent->getValue();
-    double post_prob = posterior(getAltPrior(cell), octomap::probability(log_odds));
-    // double post_prob = posterior(0.06, octomap::probability(log_odds));
-    // // If the cell has been seen
-    if (occupied_.find(cell) != occupied_.end()) {
-      // If an obstacle has at some point been spotted it is 'known space'
-      return post_prob;
-    } else if (log_odds > 0) {
-      // ROS_INFO("Cell %s is not in occupied_ but has > 50\% risk",
-      // cell.asString().c_str());
-      return post_prob;
-    }
-    // No obstacle spotted (all measurements hint towards it being free)
-    return expore_penalty_ * post_prob;
-  }
-  // No measurements at all
-  return expore_penalty_ * getAltPrior(cell);  // Risk for unexplored cells
+  float node_log_odds;
+  log_odds = getAltPriorLogOdds(cell);
+  if (!searchMap(cell.xPos(), cell.yPos(), cell.zPos(), octree_depth, node_log_odds)) {
+    scale = expore_penalty_;  // Risk for unexplored cells
+    return;
+  }
+  log_odds += node_log_odds;
+  // If an obstacle has at some point been spotted it is 'known space', as are
+  // cells with > 50% risk. Otherwise all measurements hint towards it being free
+  const OccupiedCells& occupied = shared_planner_ ? shared_planner_->occupied_ : occupied_;
+  scale = (node_log_odds > 0 || occupied.contains(cell)) ? 1.0 : expore_penalty_;
 }
 
 double GlobalPlanner::getAltPrior(const Cell& cell) {
@@ -165,34 +304,157 @@ double GlobalPlanner::getAltPrior(const Cell& cell) {
   return alt_prior_[std::round(cell.zPos())];
 }
 
+double GlobalPlanner::getAltPriorLogOdds(const Cell& cell) { return alt_prior_log_odds_[std::round(cell.zPos())]; }
+
 bool GlobalPlanner::isOccupied(const Cell& cell) { return getSingleCellRisk(cell) > 0.5; }
 
 bool GlobalPlanner::isLegal(const Node& node) {
-  return node.cell_.zPos() < max_altitude_ && getRisk(node) < max_cell_risk_;
+  return node.cell_.zPos() < max_altitude_ && isInCorridor(node.cell_) && getRisk(node) < max_cell_risk_;
+}
+
+// True if the cell is inside the corridor of the hierarchical planning, or if there is no corridor
+bool GlobalPlanner::isInCorridor(const Cell& cell) {
+  const GlobalPlanner& planner = shared_planner_ ? *shared_planner_ : *this;
+  if (planner.corridor_.empty()) {
+    return true;
+  }
+  int scale = planner.corridor_scale_;
+  Cell coarse_cell(std::tuple<int, int, int>(floorDiv(cell.xIndex(), scale), floorDiv(cell.yIndex(), scale),
+                                             floorDiv(cell.zIndex(), scale)));
+  return planner.corridor_.find(coarse_cell) != planner.corridor_.end();
+}
+
+// Risk of a block of scale^3 cells, coarse_cell holds the block indices.
+// Inner OcTree nodes hold the highest log-odds of their children, so a block
+// is as risky as its most risky cell
+double GlobalPlanner::getCoarseRisk(const Cell& coarse_cell, int scale) {
+  if ((coarse_cell.zIndex() + 1) * scale <= 1 || !octree_) {
+    return 1.0;  // Octomap does not keep track of the ground
+  }
+  int fine_depth = std::min(16, 17 - int(CELL_SCALE + 0.1));
+  int coarse_depth = std::max(1, fine_depth - static_cast<int>(std::round(std::log2(scale))));
+  double x = CELL_SCALE * scale * (coarse_cell.xIndex() + 0.5);
+  double y = CELL_SCALE * scale * (coarse_cell.yIndex() + 0.5);
+  double z = CELL_SCALE * scale * (coarse_cell.zIndex() + 0.5);
+  // The lowest cell of the block has the highest prior
+  int lowest_z = std::max(1, std::max(min_altitude_, coarse_cell.zIndex() * scale));
+  double prior_log_odds = getAltPriorLogOdds(Cell(std::tuple<int, int, int>(0, 0, lowest_z)));
+
+  // The posterior is found in log-space, like in getSingleCellRiskTerms
+  float log_odds;
+  if (searchMap(x, y, z, coarse_depth, log_odds)) {
+    double post_prob = logOddsToProbability(prior_log_odds + log_odds);
+    return log_odds > 0 ? post_prob : expore_penalty_ * post_prob;
+  }
+  return expore_penalty_ * logOddsToProbability(prior_log_odds);  // Risk for unexplored blocks
 }
 
 double GlobalPlanner::getRisk(const Cell& cell) {
-  if (risk_cache_.find(cell) != risk_cache_.end()) {
-    return risk_cache_[cell];
+  const double* cached_risk = findCachedRisk(cell);
+  if (cached_risk) {
+    stats_.risk_cache_hits++;
+    return *cached_risk;
+  }
+  stats_.risk_cache_misses++;
+
+  updateFlowOffsets();
+  double risk = computeRisk(cell);
+  risk_cache_[cell] = risk;
+  return risk;
+}
+
+// Fills risks with getRisk of each of the cells. Every uncached cell is only
+// evaluated once, in parallel when there are many, and is added to the cache
+void GlobalPlanner::getRisks(const std::vector<Cell>& cells, std::vector<double>& risks) {
+  std::vector<Cell> uncached;
+  std::unordered_set<Cell> seen;
+  for (const Cell& cell : cells) {
+    if (!findCachedRisk(cell) && seen.insert(cell).second) {
+      uncached.push_back(cell);
+    }
   }
+  stats_.risk_cache_hits += cells.size() - uncached.size();
+  stats_.risk_cache_misses += uncached.size();
 
-  double risk = getSingleCellRisk(cell);
+  if (!uncached.empty()) {
+    // Only reads the map, the cache is filled afterwards by this thread
+    updateFlowOffsets();
+    std::vector<double> uncached_risks(uncached.size());
+    const int chunk_size = 1024;
+    int num_chunks = (uncached.size() + chunk_size - 1) / chunk_size;
+    // Workers of the portfolio and mission searches already run in parallel
+    int num_threads = shared_planner_ ? 1 : numWorkerThreads(risk_query_threads_);
+    parallelFor(num_chunks, num_threads, [&](int chunk) {
+      int end = std::min<int>(uncached.size(), (chunk + 1) * chunk_size);
+      for (int i = chunk * chunk_size; i < end; ++i) {
+        uncached_risks[i] = computeRisk(uncached[i]);
+      }
+    });
+    risk_cache_.reserve(risk_cache_.size() + uncached.size());
+    for (int i = 0; i < uncached.size(); ++i) {
+      risk_cache_[uncached[i]] = uncached_risks[i];
+    }
+  }
+
+  risks.resize(cells.size());
+  for (int i = 0; i < cells.size(); ++i) {
+    risks[i] = *findCachedRisk(cells[i]);
+  }
+}
+
+// Returns the cached risk of the cell, or nullptr. Portfolio workers only read
+// the shared cache, their new values go in their own cache
+const double* GlobalPlanner::findCachedRisk(const Cell& cell) const {
+  auto it = risk_cache_.find(cell);
+  if (it != risk_cache_.end()) {
+    return &it->second;
+  }
+  if (shared_planner_) {
+    auto shared_risk = shared_planner_->risk_cache_.find(cell);
+    if (shared_risk != shared_planner_->risk_cache_.end()) {
+      return &shared_risk->second;
+    }
+  }
+  return nullptr;
+}
+
+void GlobalPlanner::updateFlowOffsets() {
   int radius = static_cast<int>(std::ceil(robot_radius_ / octree_resolution_));
-  for (const Cell& neighbor : cell.getFlowNeighbors(radius)) {
-    risk += neighbor_risk_flow_ * getSingleCellRisk(neighbor);
+  if (radius != flow_offsets_radius_) {
+    flow_offsets_ = Cell(std::tuple<int, int, int>(0, 0, 0)).getFlowNeighbors(radius);
+    flow_offsets_radius_ = radius;
   }
+}
 
-  risk_cache_[cell] = risk;
+// The risk of the cell and its flow neighbors, without the cache. Only reads
+// the planner, so it can run on several threads once updateFlowOffsets is called
+double GlobalPlanner::computeRisk(const Cell& cell) {
+  // Look up all the cells first, then the posteriors are found in one loop
+  // over contiguous arrays, which the compiler can vectorize
+  thread_local std::vector<double> log_odds;
+  thread_local std::vector<double> scales;
+  log_odds.resize(flow_offsets_.size() + 1);
+  scales.resize(flow_offsets_.size() + 1);
+  getSingleCellRiskTerms(cell, log_odds[0], scales[0]);
+  for (int i = 0; i < flow_offsets_.size(); ++i) {
+    getSingleCellRiskTerms(cell + flow_offsets_[i], log_odds[i + 1], scales[i + 1]);
+    scales[i + 1] *= neighbor_risk_flow_;
+  }
+  double risk = 0.0;
+  for (int i = 0; i < log_odds.size(); ++i) {
+    risk += scales[i] / (1.0 + std::exp(-log_odds[i]));
+  }
   return risk;
 }
 
 double GlobalPlanner::getRisk(const Node& node) {
+  // Summed over the footprint offsets, building the set of getCells() is too slow
   double risk = 0.0;
-  std::unordered_set<Cell> nodeCells = node.getCells();
-  for (const Cell& cell : nodeCells) {
-    risk += getRisk(cell);
+  const std::vector<Cell>& offsets = node.getCellOffsets();
+  for (const Cell& offset : offsets) {
+    risk += getRisk(node.parent_ + offset);
   }
-  return risk / nodeCells.size() * node.getLength();
+  return risk / offsets.size() * node.getLength();
 }
 
 // Returns the risk of the quadratic Bezier curve defined by poses
@@ -206,14 +468,24 @@ double GlobalPlanner::getRiskOfCurve(const std::vector<geometry_msgs::PoseStampe
   // Estimate the length of the curve, TODO: check if this makes sense
   double length = distance(msg[0], msg[1]) + distance(msg[1], msg[2]);
   int num_steps = std::ceil(length / CELL_SCALE);
-  // Calculate points on the curve, around one point per cell
-  auto points = threePointBezier(msg[0].pose.position, msg[1].pose.position, msg[2].pose.position, 4 * num_steps);
+  // Calculate points on the curve, around four points per cell
+  CurveSamples points;
+  threePointBezier(msg[0].pose.position, msg[1].pose.position, msg[2].pose.position, getBezierBasis(4 * num_steps),
+                   points);
 
+  // Consecutive points mostly fall in the same cell, look up the risk once per
+  // run of points and count it for every point of the run
   double risk = 0.0;
   visitor_.seen_.clear();
-  for (auto point : points) {
-    risk += getRisk(Cell(point));
-    visitor_.seen_.insert(Cell(point));
+  for (int i = 0; i < points.size();) {
+    Cell cell(points.x[i], points.y[i], points.z[i]);
+    int run_end = i + 1;
+    while (run_end < points.size() && Cell(points.x[run_end], points.y[run_end], points.z[run_end]) == cell) {
+      ++run_end;
+    }
+    risk += (run_end - i) * getRisk(cell);
+    visitor_.seen_.insert(cell);
+    i = run_end;
   }
   return risk;
 }
@@ -224,24 +496,76 @@ double GlobalPlanner::getTurnSmoothness(const Node& u, const Node& v) {
   return turn * turn;  // Squaring makes large turns more costly
 }
 
+// Returns the cost of turning from u to v
+double GlobalPlanner::getSmoothCost(const Node& u, const Node& v) {
+  double smooth_cost = smooth_factor_ * getTurnSmoothness(u, v);
+  if (u.cell_.distance3D(Cell(curr_pos_)) < 3 && norm(curr_vel_) > 1) {
+    smooth_cost *= 2;  // Penalty for a early turn when the velocity is high
+  }
+  return smooth_cost;
+}
+
 // Returns the total cost of the edge from u to v
 double GlobalPlanner::getEdgeCost(const Node& u, const Node& v) {
   double dist_cost = getEdgeDist(u.cell_, v.cell_);
   // double risk_cost = u.cell_.distance3D(v.cell_) * risk_factor_ *
   // getRisk(v.cell_);
   double risk_cost = risk_factor_ * getRisk(v);
-  double smooth_cost = smooth_factor_ * getTurnSmoothness(u, v);
-  if (u.cell_.distance3D(Cell(curr_pos_)) < 3 && norm(curr_vel_) > 1) {
-    smooth_cost *= 2;  // Penalty for a early turn when the velocity is high
+  return dist_cost + risk_cost + getSmoothCost(u, v);
+}
+
+// Walks the cells on the line from the center of u to the center of v with a
+// 3D DDA, true iff none of them is illegal. Where the line passes an edge or a
+// corner the cells around it are checked too
+bool GlobalPlanner::isLineOfSight(const Cell& u, const Cell& v) {
+  auto is_legal = [this](const Cell& cell) {
+    return cell.zPos() < max_altitude_ && isInCorridor(cell) && getRisk(cell) < max_cell_risk_;
+  };
+  int delta[3] = {v.xIndex() - u.xIndex(), v.yIndex() - u.yIndex(), v.zIndex() - u.zIndex()};
+  int index[3] = {u.xIndex(), u.yIndex(), u.zIndex()};
+  double t_max[3], t_delta[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    // The line starts in the middle of a cell, so the first boundary is half a cell away
+    t_delta[axis] = delta[axis] == 0 ? INFINITY : 1.0 / std::abs(delta[axis]);
+    t_max[axis] = 0.5 * t_delta[axis];
+  }
+  while (true) {
+    Cell cell(std::tuple<int, int, int>(index[0], index[1], index[2]));
+    if (!is_legal(cell)) {
+      return false;
+    }
+    double t = std::min(t_max[0], std::min(t_max[1], t_max[2]));
+    if (t >= 1.0) {
+      return true;  // Reached v
+    }
+    // If several axes step at once the line passes an edge or corner, and it
+    // touches the cells reached by stepping any of the subsets of these axes
+    int step[3] = {0, 0, 0};
+    int stepping_axes = 0;  // Bit mask
+    for (int axis = 0; axis < 3; ++axis) {
+      if (t_max[axis] <= t + 1e-9) {
+        step[axis] = delta[axis] > 0 ? 1 : -1;
+        t_max[axis] += t_delta[axis];
+        stepping_axes |= 1 << axis;
+      }
+    }
+    for (int subset = (stepping_axes - 1) & stepping_axes; subset > 0; subset = (subset - 1) & stepping_axes) {
+      Cell touched(std::tuple<int, int, int>(index[0] + ((subset & 1) ? step[0] : 0),
+                                             index[1] + ((subset & 2) ? step[1] : 0),
+                                             index[2] + ((subset & 4) ? step[2] : 0)));
+      if (!is_legal(touched)) {
+        return false;
+      }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      index[axis] += step[axis];
+    }
   }
-  return dist_cost + risk_cost + smooth_cost;
 }
 
 // Returns a heuristic for the cost of risk for going from u to goal
 // The heuristic is the cost of risk through unknown environment
 double GlobalPlanner::riskHeuristic(const Cell& u, const Cell& goal) {
-  // return riskHeuristicReverseCache(u, goal);  // REVERSE_SEARCH
-
   if (u == goal) {
     return 0.0;
   }
@@ -256,20 +580,6 @@ double GlobalPlanner::riskHeuristic(const Cell& u, const Cell& goal) {
   return xy_risk + z_risk + goal_risk;
 }
 
-double GlobalPlanner::riskHeuristicReverseCache(const Cell& u, const Cell& goal) {
-  if (bubble_risk_cache_.find(u) != bubble_risk_cache_.end()) {
-    return bubble_risk_cache_[u];
-  }
-  if (u == goal) {
-    return 0.0;
-  }
-  double dist_to_bubble = std::max(0.0, u.diagDistance3D(goal) - bubble_radius_);
-  double unexplored_risk = (1.0 + 6.0 * neighbor_risk_flow_) * expore_penalty_ * risk_factor_;
-  double heuristic = bubble_cost_ + dist_to_bubble * unexplored_risk * getAltPrior(u);
-  // bubble_risk_cache_[u] = heuristic;
-  return heuristic;
-}
-
 // Returns a heuristic for the cost of turning for going from u to goal
 double GlobalPlanner::smoothnessHeuristic(const Node& u, const Cell& goal) {
   if (u.cell_.xIndex() == goal.xIndex() && u.cell_.yIndex() == goal.yIndex()) {
@@ -306,25 +616,80 @@ double GlobalPlanner::altitudeHeuristic(const Cell& u, const Cell& goal) {
 
 // Returns a heuristic of going from u to goal
 double GlobalPlanner::getHeuristic(const Node& u, const Cell& goal) {
-  if (heuristic_cache_.find(u) != heuristic_cache_.end()) {
-    // return heuristic_cache_[u];    // TODO: Needs to account for different
-    // overestimating factors
-  }
-
-  // Only overestimate the distance
-  double heuristic = overestimate_factor_ * u.cell_.diagDistance2D(goal);
-  heuristic += altitudeHeuristic(u.cell_, goal);  // Lower bound cost due to altitude change
-  heuristic += smoothnessHeuristic(u, goal);      // Lower bound cost due to turning
-  if (use_risk_heuristics_) {
-    heuristic += riskHeuristic(u.cell_, goal);  // Risk through a straight-line path of unexplored space
+  stats_.heuristic_evaluations++;
+  double heuristic = smoothnessHeuristic(u, goal);  // Lower bound cost due to turning
+  // Workers searching for the same goal use the field of the shared planner, mission legs have their own
+  bool use_shared_field = shared_planner_ && shared_planner_->goal_pos_ == goal_pos_;
+  const HeuristicField& field = use_shared_field ? shared_planner_->heuristic_field_ : heuristic_field_;
+  double cost_to_goal = field.getCostToGoal(u.cell_);
+  if (cost_to_goal < INFINITY) {
+    // Lower bound of the distance, altitude and risk cost, only overestimate the distance
+    heuristic += cost_to_goal + (overestimate_factor_ - 1.0) * u.cell_.diagDistance2D(goal);
+  } else {
+    // Only overestimate the distance
+    heuristic += overestimate_factor_ * u.cell_.diagDistance2D(goal);
+    heuristic += altitudeHeuristic(u.cell_, goal);  // Lower bound cost due to altitude change
+    if (use_risk_heuristics_) {
+      heuristic += riskHeuristic(u.cell_, goal);  // Risk through a straight-line path of unexplored space
+    }
   }
   if (use_speedup_heuristics_) {
     heuristic += visitor_.seen_count_[u.cell_];
   }
-  heuristic_cache_[u] = heuristic;
   return heuristic;
 }
 
+HeuristicFieldParameters GlobalPlanner::getHeuristicFieldParameters() {
+  HeuristicFieldParameters params;
+  params.min_altitude = min_altitude_;
+  params.max_altitude = max_altitude_;
+  params.margin = heuristic_field_margin_;
+  params.scale = heuristic_field_scale_;
+  params.is_3D = heuristic_field_3d_;
+  params.risk_factor = risk_factor_;
+  params.up_cost = up_cost_;
+  params.down_cost = down_cost_;
+  params.max_cell_risk = max_cell_risk_;
+  return params;
+}
+
+// Computes the heuristic field for a new goal, or repairs it after map updates
+void GlobalPlanner::updateHeuristicField(const Cell& start, const GoalCell& goal) {
+  if (!use_heuristic_field_) {
+    heuristic_field_.clear();
+    heuristic_field_changed_cells_.clear();
+    return;
+  }
+  ScopedPhaseTimer timer(stats_, "heuristic_field");
+  auto cell_risk = [this](const Cell& cell) { return getRisk(cell); };
+  HeuristicFieldParameters params = getHeuristicFieldParameters();
+  std::clock_t start_time = std::clock();
+  if (!heuristic_field_.covers(goal, start, params)) {
+    // A corridor bounds the search already, and the field would cover the whole
+    // box around it. Also skip fields that are too large, e.g. kilometer-scale missions
+    heuristic_field_changed_cells_.clear();
+    if (!corridor_.empty() || HeuristicField::numCells(goal, start, params) > heuristic_field_max_cells_) {
+      heuristic_field_.clear();
+      return;
+    }
+    heuristic_field_.compute(goal, start, params, cell_risk);
+    ROS_INFO("Computed heuristic field with %d cells in %2.1f ms", heuristic_field_.size(),
+             clocksToMicroSec(start_time, std::clock()) / 1000.0);
+  } else if (heuristic_field_outdated_) {
+    int num_changed = heuristic_field_.refresh(cell_risk);
+    ROS_INFO("Refreshed heuristic field, %d changed cells in %2.1f ms", num_changed,
+             clocksToMicroSec(start_time, std::clock()) / 1000.0);
+  } else if (!heuristic_field_changed_cells_.empty()) {
+    updateFlowOffsets();  // The risk of a cell reads the cells within flow_offsets_radius_
+    int num_changed = heuristic_field_.refresh(cell_risk, heuristic_field_changed_cells_, flow_offsets_radius_);
+    ROS_INFO("Refreshed heuristic field around %d map cells, %d changed cells in %2.1f ms",
+             (int)heuristic_field_changed_cells_.size(), num_changed,
+             clocksToMicroSec(start_time, std::clock()) / 1000.0);
+  }
+  heuristic_field_outdated_ = false;
+  heuristic_field_changed_cells_.clear();
+}
+
 geometry_msgs::PoseStamped GlobalPlanner::createPoseMsg(const Cell& cell, double yaw) {
   geometry_msgs::PoseStamped pose_msg;
   pose_msg.header.frame_id = frame_id_;
@@ -346,6 +711,7 @@ nav_msgs::Path GlobalPlanner::getPathMsg(const std::vector<Cell>& path) {
   // Use actual position instead of the center of the cell
   double last_yaw = curr_yaw_;
 
+  path_msg.poses.reserve(path.size());
   for (int i = 0; i < path.size() - 1; ++i) {
     Cell p = path[i];
     double new_yaw = nextYaw(p, path[i + 1], last_yaw);
@@ -365,16 +731,30 @@ PathWithRiskMsg GlobalPlanner::getPathWithRiskMsg() {
   risk_msg.header = path_msg.header;
   risk_msg.poses = path_msg.poses;
 
+  std::vector<Cell> cells;
+  cells.reserve(path_msg.poses.size());
   for (const auto& pose : path_msg.poses) {
-    double risk = getRisk(Cell(pose.pose.position));
-    risk_msg.risks.push_back(risk);
+    cells.push_back(Cell(pose.pose.position));
   }
+  std::vector<double> risks;
+  getRisks(cells, risks);
+  risk_msg.risks.assign(risks.begin(), risks.end());
   return risk_msg;
 }
 
 // Returns details of the cost of the path
 PathInfo GlobalPlanner::getPathInfo(const std::vector<Cell>& path) {
   PathInfo path_info = {};
+  // Fill the cache with the footprints of all the edges in one batch
+  std::vector<Cell> footprint;
+  for (int i = 2; i < path.size(); ++i) {
+    for (const Cell& offset : getCellOffsets(path[i - 1], path[i])) {
+      footprint.push_back(path[i - 1] + offset);
+    }
+  }
+  std::vector<double> footprint_risks;
+  getRisks(footprint, footprint_risks);
+
   for (int i = 2; i < path.size(); ++i) {
     Node curr_node = Node(path[i], path[i - 1]);
     Node last_node = Node(path[i - 1], path[i - 2]);
@@ -389,7 +769,8 @@ PathInfo GlobalPlanner::getPathInfo(const std::vector<Cell>& path) {
 }
 
 // Chooses the node-type of the search
-NodePtr GlobalPlanner::getStartNode(const Cell& start, const Cell& parent, const std::string& type) {
+NodePtr GlobalPlanner::getStartNode(const Cell& start, const Cell& parent, const std::string& type,
+                                    double speednode_radius) {
   if (type == "Node") {
     return NodePtr(new Node(start, parent));
   }
@@ -397,7 +778,10 @@ NodePtr GlobalPlanner::getStartNode(const Cell& start, const Cell& parent, const
     return NodePtr(new NodeWithoutSmooth(start, parent));
   }
   if (type == "SpeedNode") {
-    return NodePtr(new SpeedNode(start, parent));
+    return NodePtr(new SpeedNode(start, parent, speednode_radius));
+  }
+  if (type == "LatticeNode") {
+    return NodePtr(new LatticeNode(start, parent, &getMotionPrimitives(speednode_radius)));
   }
 }
 
@@ -424,7 +808,7 @@ bool GlobalPlanner::findPath(std::vector<Cell>& path) {
   int iter_left = max_iterations_;
   int last_iter = 0;
 
-  // reverseSearch(t); // REVERSE_SEARCH
+  updateHeuristicField(s, t);
 
   printf("Search              iter_time overest   num_iter  path_cost \n");
   while (overestimate_factor_ >= min_overestimate_factor_ && iter_left > last_iter) {
@@ -438,9 +822,20 @@ bool GlobalPlanner::findPath(std::vector<Cell>& path) {
       node_type = "NodeWithoutSmooth";
     }
 
-    NodePtr start_node = getStartNode(s, parent_of_s, node_type);
-    search_info = findSmoothPath(this, new_path, start_node, t, iter_left, visitor_);
+    if (use_any_angle_search_) {
+      search_info = findAnyAnglePath(this, new_path, s, parent_of_s, t, iter_left, visitor_);
+      node_type = "AnyAngle";
+    } else if (node_type == "NodeWithoutSmooth" && use_bidirectional_search_) {
+      search_info =
+          findSmoothPathBidirectional(this, new_path, s, parent_of_s, t, iter_left, use_bidirectional_threads_);
+      node_type = "Bidirectional";
+    } else {
+      NodePtr start_node = getStartNode(s, parent_of_s, node_type);
+      search_info = findSmoothPath(this, new_path, start_node, t, iter_left, visitor_);
+    }
     printSearchInfo(search_info, node_type, overestimate_factor_);
+    stats_.addSearch(search_info.num_iter, search_info.max_open_size);
+    stats_.addPhase("search_round", search_info.search_time / 1000.0);
 
     if (search_info.found_path) {
       PathInfo path_info = getPathInfo(new_path);
@@ -460,10 +855,12 @@ bool GlobalPlanner::findPath(std::vector<Cell>& path) {
     overestimate_factor_ = (overestimate_factor_ - 1.0) / 4.0 + 1.0;
   }
 
-  // Last resort, try 2d search at max_altitude_
-  if (!found_path) {
+  // Last resort, try 2d search at max_altitude_. find2DPath ignores the
+  // corridor, so with a corridor findPathHierarchical decides the fallback
+  if (!found_path && corridor_.empty()) {
     printf("No path found, search in 2D \n");
     max_iterations_ = 5000;
+    ScopedPhaseTimer timer(stats_, "search_2d");
     found_path = find2DPath(this, path, s, t, parent_of_s, max_altitude_);
   }
 
@@ -491,30 +888,93 @@ bool GlobalPlanner::getGlobalPath() {
   } else {
     // Both current position and goal are free, try to find a path
     std::vector<Cell> path;
-    if (!findPath(path)) {
+    bool found_path = false;
+    if (use_hierarchical_planning_) {
+      found_path = findPathHierarchical(path);
+    } else {
+      found_path = use_portfolio_search_ ? findPathPortfolio(path) : findPath(path);
+    }
+    if (!found_path) {
       double goal_risk = getRisk(t);
       ROS_INFO("  Failed to find a path, risk of t: %3.2f", goal_risk);
       goal_is_blocked_ = true;
       return false;
     }
     setPath(path);
+    path_goal_ = goal_pos_;
+    path_is_valid_ = true;
+    path_risk_outdated_ = false;
     return true;
   }
 }
 
+// Returns true if curr_path_ can still be followed: it was planned for the
+// current goal, the vehicle is close to it and no map update has made any of
+// its remaining edges illegal. Only the risks along the path are recomputed,
+// the cells whose cached risk is still valid are not looked up in the octomap
+bool GlobalPlanner::isCurrentPathValid() {
+  if (!path_is_valid_ || going_back_ || curr_path_.size() < 2 || !(goal_pos_ == path_goal_) ||
+      goal_pos_.radius_ != path_goal_.radius_) {
+    return false;
+  }
+
+  // The edge of the path closest to the vehicle
+  int closest_edge = 1;
+  double closest_dist = INFINITY;
+  for (int i = 1; i < curr_path_.size(); ++i) {
+    double dist = distanceToSegment(curr_pos_, curr_path_[i - 1].toPoint(), curr_path_[i].toPoint());
+    if (dist < closest_dist) {
+      closest_dist = dist;
+      closest_edge = i;
+    }
+  }
+  if (closest_dist > max_path_deviation_) {
+    ROS_INFO("Deviated %2.2f m from the current path", closest_dist);
+    path_is_valid_ = false;
+    return false;
+  }
+
+  if (path_risk_outdated_) {
+    // The first edge starts behind the vehicle and was never checked by the search
+    if (!isPathLegal(curr_path_, std::max(2, closest_edge))) {
+      ROS_INFO("The current path is blocked");
+      path_is_valid_ = false;
+      return false;
+    }
+    path_risk_outdated_ = false;
+  }
+  return true;
+}
+
+// Returns true if the edges of path from first_edge on are all legal
+bool GlobalPlanner::isPathLegal(const std::vector<Cell>& path, int first_edge) {
+  for (int i = std::max(1, first_edge); i < path.size(); ++i) {
+    if (!isLegal(Node(path[i], path[i - 1]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Sets the current path to be the path back until a safe cell is reached
 // Then the mission can be tried again or a new mission can be set
 void GlobalPlanner::goBack() {
   ROS_INFO("  GO BACK ");
   going_back_ = true;
-  std::vector<Cell> new_path = path_back_;
-  std::reverse(new_path.begin(), new_path.end());
+  path_is_valid_ = false;
+  if (path_back_.empty()) {
+    path_back_.push_back(Cell(curr_pos_));
+  }
 
   // Follow the path back until the risk is low
-  for (int i = 1; i < new_path.size() - 1; ++i) {
-    if (i > 5 && getRisk(new_path[i]) < 0.5) {
-      new_path.resize(i + 1);                        // new_path is the last i+1 positions of path_back_
-      path_back_.resize(path_back_.size() - i - 2);  // Remove part of path_back_ that is also in new_path
+  std::vector<Cell> new_path;
+  int path_back_size = path_back_.size();
+  for (auto it = path_back_.rbegin(); it != path_back_.rend(); ++it) {
+    int i = new_path.size();
+    new_path.push_back(*it);
+    if (i > 5 && i < path_back_size - 1 && getRisk(new_path[i]) < 0.5) {
+      // new_path is the last i+1 positions of path_back_
+      path_back_.popBack(i + 2);  // Remove part of path_back_ that is also in new_path
       break;
     }
   }
@@ -529,4 +989,280 @@ void GlobalPlanner::stop() {
 
 void GlobalPlanner::setRobotRadius(double radius) { robot_radius_ = radius; }
 
+// Copies everything a search needs, but none of the caches
+void GlobalPlanner::copySearchParameters(const GlobalPlanner& other) {
+  octree_ = other.octree_;
+  flat_map_ = other.flat_map_;
+  octree_resolution_ = other.octree_resolution_;
+  robot_radius_ = other.robot_radius_;
+  alt_prior_ = other.alt_prior_;
+  accumulated_alt_prior_ = other.accumulated_alt_prior_;
+  alt_prior_log_odds_ = other.alt_prior_log_odds_;
+  curr_pos_ = other.curr_pos_;
+  curr_yaw_ = other.curr_yaw_;
+  curr_vel_ = other.curr_vel_;
+  goal_pos_ = other.goal_pos_;
+  overestimate_factor_ = other.overestimate_factor_;
+  min_altitude_ = other.min_altitude_;
+  max_altitude_ = other.max_altitude_;
+  max_cell_risk_ = other.max_cell_risk_;
+  smooth_factor_ = other.smooth_factor_;
+  vert_to_hor_cost_ = other.vert_to_hor_cost_;
+  risk_factor_ = other.risk_factor_;
+  neighbor_risk_flow_ = other.neighbor_risk_flow_;
+  expore_penalty_ = other.expore_penalty_;
+  up_cost_ = other.up_cost_;
+  down_cost_ = other.down_cost_;
+  search_time_ = other.search_time_;
+  min_overestimate_factor_ = other.min_overestimate_factor_;
+  max_overestimate_factor_ = other.max_overestimate_factor_;
+  max_iterations_ = other.max_iterations_;
+  use_current_yaw_ = other.use_current_yaw_;
+  use_risk_heuristics_ = other.use_risk_heuristics_;
+  use_speedup_heuristics_ = other.use_speedup_heuristics_;
+  use_heuristic_field_ = other.use_heuristic_field_;
+  heuristic_field_3d_ = other.heuristic_field_3d_;
+  heuristic_field_scale_ = other.heuristic_field_scale_;
+  heuristic_field_margin_ = other.heuristic_field_margin_;
+  heuristic_field_max_cells_ = other.heuristic_field_max_cells_;
+  default_node_type_ = other.default_node_type_;
+  use_any_angle_search_ = other.use_any_angle_search_;
+  use_bidirectional_search_ = other.use_bidirectional_search_;
+  use_bidirectional_threads_ = other.use_bidirectional_threads_;
+  frame_id_ = other.frame_id_;
+  search_deadline_ = other.search_deadline_;
+}
+
+// True if the current search has run past its deadline and should give up
+bool GlobalPlanner::isSearchCancelled() const { return std::chrono::steady_clock::now() > search_deadline_; }
+
+// The searches of the portfolio, the same overestimate schedule as findPath
+// but with the node types and SpeedNode radii as extra dimensions
+std::vector<PortfolioConfig> GlobalPlanner::getPortfolioConfigs() {
+  std::vector<PortfolioConfig> configs;
+  double factor = max_overestimate_factor_;
+  for (int i = 0; i < 8 && factor >= min_overestimate_factor_; ++i) {
+    if (factor > 1.5) {
+      configs.push_back({"NodeWithoutSmooth", factor, SPEEDNODE_RADIUS});
+    } else {
+      configs.push_back({default_node_type_, factor, SPEEDNODE_RADIUS});
+      if (default_node_type_ == "SpeedNode" || default_node_type_ == "LatticeNode") {
+        configs.push_back({default_node_type_, factor, 0.5 * SPEEDNODE_RADIUS});
+      } else {
+        configs.push_back({"SpeedNode", factor, SPEEDNODE_RADIUS});
+      }
+    }
+    factor = (factor - 1.0) / 4.0 + 1.0;
+  }
+  return configs;
+}
+
+// Runs the portfolio searches concurrently and returns the cheapest path found
+// before the deadline. Searches still running at the deadline are cancelled
+bool GlobalPlanner::findPathPortfolio(std::vector<Cell>& path) {
+  Cell s(addPoints(curr_pos_, scalePoint(curr_vel_, search_time_)));
+  GoalCell t = goal_pos_;
+  Cell parent_of_s(subtractPoints(curr_pos_, scalePoint(curr_vel_, search_time_)));
+  if (!use_current_yaw_) {
+    parent_of_s = s;  // Ignore the current yaw
+  }
+  ROS_INFO("Planning a path from %s to %s (portfolio)", s.asString().c_str(), t.asString().c_str());
+  updateHeuristicField(s, t);
+
+  std::vector<PortfolioConfig> configs = getPortfolioConfigs();
+  std::vector<GlobalPlanner> workers(configs.size());
+  std::vector<std::vector<Cell> > paths(configs.size());
+  std::vector<SearchInfo> infos(configs.size());
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                      std::chrono::duration<double>(portfolio_deadline_));
+
+  for (int i = 0; i < configs.size(); ++i) {
+    workers[i].copySearchParameters(*this);
+    workers[i].shared_planner_ = this;
+    workers[i].search_deadline_ = deadline;
+    workers[i].overestimate_factor_ = configs[i].overestimate_factor;
+  }
+
+  // The workers only read the caches of this planner while the threads run
+  parallelFor(configs.size(), numWorkerThreads(portfolio_threads_), [&](int i) {
+    if (use_any_angle_search_) {
+      infos[i] = findAnyAnglePath(&workers[i], paths[i], s, parent_of_s, t, max_iterations_, workers[i].visitor_);
+      return;
+    }
+    if (configs[i].node_type == "NodeWithoutSmooth" && use_bidirectional_search_) {
+      infos[i] = findSmoothPathBidirectional(&workers[i], paths[i], s, parent_of_s, t, max_iterations_);
+      return;
+    }
+    NodePtr start_node = workers[i].getStartNode(s, parent_of_s, configs[i].node_type, configs[i].speednode_radius);
+    infos[i] = findSmoothPath(&workers[i], paths[i], start_node, t, max_iterations_, workers[i].visitor_);
+  });
+
+  printf("Search              iter_time overest   num_iter  path_cost \n");
+  int best = -1;
+  double best_path_cost = INFINITY;
+  for (int i = 0; i < configs.size(); ++i) {
+    risk_cache_.insert(workers[i].risk_cache_.begin(), workers[i].risk_cache_.end());
+    stats_.merge(workers[i].stats_);
+    stats_.addSearch(infos[i].num_iter, infos[i].max_open_size);
+    stats_.addPhase("search_round", infos[i].search_time / 1000.0);
+    printSearchInfo(infos[i], configs[i].node_type, configs[i].overestimate_factor);
+    if (!infos[i].found_path) {
+      printf("(radius: %2.2f, no path) \n", configs[i].speednode_radius);
+      continue;
+    }
+    PathInfo path_info = getPathInfo(paths[i]);
+    printf("(radius: %2.2f, cost: %2.2f, dist: %2.2f, risk: %2.2f, smooth: %2.2f) \n", configs[i].speednode_radius,
+           path_info.cost, path_info.dist, path_info.risk, path_info.smoothness);
+    if (path_info.cost < best_path_cost) {
+      best_path_cost = path_info.cost;
+      best = i;
+    }
+  }
+
+  if (best < 0) {
+    if (!corridor_.empty()) {
+      return false;  // find2DPath ignores the corridor, findPathHierarchical decides the fallback
+    }
+    // Last resort, try 2d search at max_altitude_
+    printf("No path found, search in 2D \n");
+    ScopedPhaseTimer timer(stats_, "search_2d");
+    return find2DPath(this, path, s, t, parent_of_s, max_altitude_);
+  }
+  path = paths[best];
+  overestimate_factor_ = configs[best].overestimate_factor;
+  visitor_ = workers[best].visitor_;
+  return true;
+}
+
+// Fills corridor_ with the coarse cells within corridor_width_ of the coarse path
+void GlobalPlanner::setCorridor(const std::vector<Cell>& coarse_path, int scale) {
+  corridor_.clear();
+  corridor_scale_ = scale;
+  for (const Cell& coarse_cell : coarse_path) {
+    for (int dx = -corridor_width_; dx <= corridor_width_; ++dx) {
+      for (int dy = -corridor_width_; dy <= corridor_width_; ++dy) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          corridor_.insert(Cell(std::tuple<int, int, int>(coarse_cell.xIndex() + dx, coarse_cell.yIndex() + dy,
+                                                          coarse_cell.zIndex() + dz)));
+        }
+      }
+    }
+  }
+}
+
+// Plans on coarse blocks of cells first, then searches at full resolution only
+// inside a corridor around the coarse path. The search in the corridor has no
+// 2D fallback, if either step fails the whole map is searched, with the 2D
+// search as the last resort
+bool GlobalPlanner::findPathHierarchical(std::vector<Cell>& path) {
+  Cell s(addPoints(curr_pos_, scalePoint(curr_vel_, search_time_)));
+  int scale = 1 << std::max(0, hierarchy_levels_);
+  std::vector<Cell> coarse_path;
+  std::clock_t start_time = std::clock();
+  bool found_coarse_path = findCoarsePath(this, coarse_path, s, goal_pos_, scale);
+  ROS_INFO("Coarse search with %d cell blocks: %s, %d blocks in %2.1f ms", scale,
+           found_coarse_path ? "found" : "failed", static_cast<int>(coarse_path.size()),
+           clocksToMicroSec(start_time, std::clock()) / 1000.0);
+
+  bool found_path = false;
+  if (found_coarse_path) {
+    setCorridor(coarse_path, scale);
+    // Long corridors need more iterations than max_iterations_ allows
+    int saved_max_iterations = max_iterations_;
+    max_iterations_ = std::max(max_iterations_, 4 * scale * static_cast<int>(coarse_path.size()));
+    found_path = use_portfolio_search_ ? findPathPortfolio(path) : findPath(path);
+    max_iterations_ = saved_max_iterations;
+    corridor_.clear();
+  }
+  if (!found_path) {
+    ROS_INFO("No path in the corridor, searching without it");
+    found_path = use_portfolio_search_ ? findPathPortfolio(path) : findPath(path);
+  }
+  return found_path;
+}
+
+// Plans the legs between the current goal and the waypoints after it, leg i
+// ends at waypoints[i]. Legs that are still legal are kept, the others are
+// planned concurrently, each from the end cell of the previous leg. The
+// workers read the risk cache of this planner and their new risks are merged
+// into it, so the legs and the next searches share the risk computations
+void GlobalPlanner::planMission(const std::vector<GoalCell>& waypoints) {
+  std::vector<MissionLeg> legs;
+  std::vector<int> legs_to_plan;
+  for (int i = 0; i < waypoints.size(); ++i) {
+    const GoalCell& start = i == 0 ? goal_pos_ : waypoints[i - 1];
+    const GoalCell& goal = waypoints[i];
+    MissionLeg leg = {goal, {}, false};
+    if (i < mission_legs_.size() && mission_legs_[i].goal == goal && mission_legs_[i].goal.radius_ == goal.radius_ &&
+        !mission_legs_[i].path.empty() && start.withinPlanRadius(mission_legs_[i].path.front())) {
+      leg = mission_legs_[i];
+      if (leg.risk_outdated && !isPathLegal(leg.path, 2)) {
+        leg.path.clear();
+      }
+      leg.risk_outdated = false;
+    }
+    if (leg.path.empty()) {
+      legs_to_plan.push_back(i);
+    }
+    legs.push_back(leg);
+  }
+  mission_legs_.swap(legs);
+  if (legs_to_plan.empty()) {
+    return;
+  }
+
+  std::clock_t start_time = std::clock();
+  std::vector<GlobalPlanner> workers(legs_to_plan.size());
+  for (int j = 0; j < legs_to_plan.size(); ++j) {
+    int i = legs_to_plan[j];
+    // Start at the end of the previous leg if it is known, otherwise at its goal
+    Cell start = i == 0 ? Cell(goal_pos_) : Cell(waypoints[i - 1]);
+    if (i > 0 && !mission_legs_[i - 1].path.empty()) {
+      start = mission_legs_[i - 1].path.back();
+    }
+    workers[j].copySearchParameters(*this);
+    workers[j].shared_planner_ = this;
+    workers[j].curr_pos_ = start.toPoint();
+    workers[j].curr_vel_ = geometry_msgs::Vector3();
+    workers[j].goal_pos_ = waypoints[i];
+  }
+
+  // The workers only read the caches of this planner while the threads run
+  parallelFor(workers.size(), numWorkerThreads(mission_threads_),
+              [&](int j) { workers[j].findPath(mission_legs_[legs_to_plan[j]].path); });
+
+  int num_found = 0;
+  for (int j = 0; j < workers.size(); ++j) {
+    risk_cache_.insert(workers[j].risk_cache_.begin(), workers[j].risk_cache_.end());
+    stats_.merge(workers[j].stats_);
+    num_found += !mission_legs_[legs_to_plan[j]].path.empty();
+  }
+  ROS_INFO("Planned %d of %d mission legs in %2.1f ms", num_found, (int)legs_to_plan.size(),
+           clocksToMicroSec(start_time, std::clock()) / 1000.0);
+}
+
+// Sets the path of the first mission leg as the current path if it leads to
+// the current goal and starts close to the vehicle. Returns true if it did.
+// The leg is removed either way, since the mission has moved past its start
+bool GlobalPlanner::useMissionLeg() {
+  if (mission_legs_.empty()) {
+    return false;
+  }
+  MissionLeg leg = mission_legs_.front();
+  mission_legs_.erase(mission_legs_.begin());
+  if (leg.path.size() < 2 || !(leg.goal == goal_pos_) || leg.goal.radius_ != goal_pos_.radius_ ||
+      distance(curr_pos_, leg.path.front().toPoint()) > max_path_deviation_) {
+    return false;
+  }
+  if (leg.risk_outdated && !isPathLegal(leg.path, 2)) {
+    return false;
+  }
+  setPath(leg.path);
+  path_goal_ = goal_pos_;
+  path_is_valid_ = true;
+  path_risk_outdated_ = false;
+  return true;
+}
+
 }  // namespace global_planner
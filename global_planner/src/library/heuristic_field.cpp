@@ -0,0 +1,401 @@
+#include "global_planner/heuristic_field.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+
+namespace global_planner {
+
+namespace {
+const float kUnreachable = std::numeric_limits<float>::infinity();
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void writeVector(std::ostream& out, const std::vector<T>& values) {
+  writeValue(out, static_cast<uint64_t>(values.size()));
+  out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::istream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+bool readVector(std::istream& in, std::vector<T>& values) {
+  uint64_t size = 0;
+  if (!readValue(in, size) || size > (1ull << 32)) {
+    return false;
+  }
+  values.resize(size);
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()), size * sizeof(T)));
+}
+}  // namespace
+
+// Fills the field for a new goal, the box covers start and goal with a margin
+void HeuristicField::compute(const GoalCell& goal, const Cell& start, const HeuristicFieldParameters& params,
+                             const RiskFunction& cell_risk) {
+  goal_ = goal;
+  params_ = params;
+  params_.scale = std::max(1, params.scale);
+  int scale = params_.scale;
+  x0_ = std::min(goal.xIndex(), start.xIndex()) - params_.margin;
+  y0_ = std::min(goal.yIndex(), start.yIndex()) - params_.margin;
+  z0_ = params_.min_altitude;
+  size_x_ = (std::max(goal.xIndex(), start.xIndex()) + params_.margin - x0_) / scale + 1;
+  size_y_ = (std::max(goal.yIndex(), start.yIndex()) + params_.margin - y0_) / scale + 1;
+  size_z_ = params_.is_3D ? std::max(1, params_.max_altitude - params_.min_altitude + 1) : 1;
+
+  Cell origin(std::tuple<int, int, int>(0, 0, 0));
+  step_xy_ = Cell(std::tuple<int, int, int>(scale, 0, 0)).xPos() - origin.xPos();
+  step_z_ = Cell(std::tuple<int, int, int>(0, 0, 1)).zPos() - origin.zPos();
+
+  computeRisks(cell_risk, risk_);
+
+  // The field cells that contain a cell within the plan radius of the goal
+  goal_cells_.clear();
+  int goal_steps = std::ceil(goal.radius_ / 2.0 / step_z_);
+  for (int dx = -goal_steps; dx <= goal_steps; ++dx) {
+    for (int dy = -goal_steps; dy <= goal_steps; ++dy) {
+      for (int dz = -goal_steps; dz <= goal_steps; ++dz) {
+        Cell cell(std::tuple<int, int, int>(goal.xIndex() + dx, goal.yIndex() + dy, goal.zIndex() + dz));
+        int idx = fieldIndex(cell);
+        if (idx >= 0 && goal.withinPlanRadius(cell) &&
+            std::find(goal_cells_.begin(), goal_cells_.end(), idx) == goal_cells_.end()) {
+          goal_cells_.push_back(idx);
+        }
+      }
+    }
+  }
+  computeDistances();
+}
+
+// Updates all risks after the map was replaced and repairs the distances of
+// the cells whose path to the goal is affected. Returns the number of changed field cells
+int HeuristicField::refresh(const RiskFunction& cell_risk) {
+  if (!isValid()) {
+    return 0;
+  }
+  std::vector<float> new_risk;
+  computeRisks(cell_risk, new_risk);
+  std::vector<int> changed;
+  for (int i = 0; i < new_risk.size(); ++i) {
+    if (new_risk[i] != risk_[i]) {
+      changed.push_back(i);
+    }
+  }
+  risk_.swap(new_risk);
+  return repair(changed);
+}
+
+// Updates the risks after changed_cells were updated in the map. The risk of
+// a cell reads the cells within radius of it, so only the field cells within
+// radius of a changed cell are evaluated again
+int HeuristicField::refresh(const RiskFunction& cell_risk, const std::unordered_set<Cell>& changed_cells,
+                            int radius) {
+  if (!isValid()) {
+    return 0;
+  }
+  int scale = params_.scale;
+  std::unordered_set<int> is_evaluated;
+  std::vector<int> changed;
+  for (const Cell& cell : changed_cells) {
+    int min_i = std::max(0, floorDiv(cell.xIndex() - radius - x0_, scale));
+    int max_i = std::min(size_x_ - 1, floorDiv(cell.xIndex() + radius - x0_, scale));
+    int min_j = std::max(0, floorDiv(cell.yIndex() - radius - y0_, scale));
+    int max_j = std::min(size_y_ - 1, floorDiv(cell.yIndex() + radius - y0_, scale));
+    int min_z = std::max(params_.min_altitude, cell.zIndex() - radius);
+    int max_z = std::min(params_.max_altitude, cell.zIndex() + radius);
+    for (int z = min_z; z <= max_z; ++z) {
+      int k = params_.is_3D ? z - z0_ : 0;
+      for (int j = min_j; j <= max_j; ++j) {
+        for (int i = min_i; i <= max_i; ++i) {
+          int idx = index(i, j, k);
+          if (!is_evaluated.insert(idx).second) {
+            continue;
+          }
+          float risk = computeRisk(cell_risk, idx);
+          if (risk != risk_[idx]) {
+            risk_[idx] = risk;
+            changed.push_back(idx);
+          }
+        }
+      }
+    }
+  }
+  return repair(changed);
+}
+
+// Repairs the distances after the risks of the changed field cells were
+// updated, only the cells whose path to the goal is affected are searched again
+int HeuristicField::repair(const std::vector<int>& changed) {
+  if (changed.empty()) {
+    return 0;
+  }
+  if (4 * changed.size() > risk_.size()) {
+    computeDistances();  // Cheaper to start over
+    return changed.size();
+  }
+
+  // A changed risk changes the cost of the edges from the cell and its neighbors
+  std::unordered_set<int> is_affected;
+  std::vector<int> affected;
+  std::vector<int> neighbor_cells;
+  auto addAffected = [&](int idx) {
+    if (is_affected.insert(idx).second) {
+      affected.push_back(idx);
+    }
+  };
+  for (int idx : changed) {
+    addAffected(idx);
+    neighbors(idx, neighbor_cells);
+    for (int n : neighbor_cells) {
+      addAffected(n);
+    }
+  }
+
+  // Every cell whose path to the goal goes through an affected cell is also
+  // affected. The next cell is always a neighbor, so the tree is walked down
+  // from the affected cells
+  for (int a = 0; a < affected.size(); ++a) {
+    int parent = affected[a];
+    neighbors(parent, neighbor_cells);
+    for (int n : neighbor_cells) {
+      if (next_[n] == parent) {
+        addAffected(n);
+      }
+    }
+  }
+
+  std::vector<std::pair<float, int> > heap;
+  for (int idx : affected) {
+    dist_[idx] = kUnreachable;
+    next_[idx] = -1;
+  }
+  for (int idx : goal_cells_) {
+    dist_[idx] = 0.0f;
+    next_[idx] = -1;
+    heap.push_back(std::make_pair(0.0f, idx));
+  }
+  // Affected cells start from their best unaffected neighbor
+  for (int idx : affected) {
+    neighbors(idx, neighbor_cells);
+    for (int n : neighbor_cells) {
+      float new_dist = dist_[n] + edgeCost(idx, n);
+      if (new_dist < dist_[idx]) {
+        dist_[idx] = new_dist;
+        next_[idx] = n;
+      }
+    }
+    if (dist_[idx] < kUnreachable) {
+      heap.push_back(std::make_pair(dist_[idx], idx));
+    }
+  }
+  propagate(heap);
+  return changed.size();
+}
+
+void HeuristicField::clear() {
+  risk_.clear();
+  dist_.clear();
+  next_.clear();
+  goal_cells_.clear();
+}
+
+void HeuristicField::write(std::ostream& out) const {
+  int goal[] = {goal_.xIndex(), goal_.yIndex(), goal_.zIndex()};
+  writeValue(out, goal);
+  writeValue(out, goal_.radius_);
+  writeValue(out, params_);
+  int box[] = {x0_, y0_, z0_, size_x_, size_y_, size_z_};
+  writeValue(out, box);
+  writeValue(out, step_xy_);
+  writeValue(out, step_z_);
+  writeVector(out, risk_);
+  writeVector(out, dist_);
+  writeVector(out, next_);
+  writeVector(out, goal_cells_);
+}
+
+bool HeuristicField::read(std::istream& in) {
+  int goal[3];
+  int box[6];
+  bool ok = readValue(in, goal) && readValue(in, goal_.radius_) && readValue(in, params_) &&
+            readValue(in, box) && readValue(in, step_xy_) && readValue(in, step_z_) && readVector(in, risk_) &&
+            readVector(in, dist_) && readVector(in, next_) && readVector(in, goal_cells_);
+  long num_cells = static_cast<long>(box[3]) * box[4] * box[5];
+  if (!ok || num_cells != dist_.size() || risk_.size() != dist_.size() || next_.size() != dist_.size()) {
+    clear();
+    return false;
+  }
+  goal_ = GoalCell(Cell(std::tuple<int, int, int>(goal[0], goal[1], goal[2])), goal_.radius_);
+  x0_ = box[0];
+  y0_ = box[1];
+  z0_ = box[2];
+  size_x_ = box[3];
+  size_y_ = box[4];
+  size_z_ = box[5];
+  return true;
+}
+
+// True if the field was computed for this goal and parameters and contains start
+bool HeuristicField::covers(const GoalCell& goal, const Cell& start, const HeuristicFieldParameters& params) const {
+  return isValid() && goal == goal_ && goal.radius_ == goal_.radius_ && fieldIndex(start) >= 0 &&
+         params.min_altitude == params_.min_altitude && params.max_altitude == params_.max_altitude &&
+         params.margin == params_.margin && std::max(1, params.scale) == params_.scale &&
+         params.is_3D == params_.is_3D && params.risk_factor == params_.risk_factor &&
+         params.up_cost == params_.up_cost && params.down_cost == params_.down_cost &&
+         params.max_cell_risk == params_.max_cell_risk;
+}
+
+// The number of field cells compute would allocate
+long HeuristicField::numCells(const GoalCell& goal, const Cell& start, const HeuristicFieldParameters& params) {
+  int scale = std::max(1, params.scale);
+  long size_x = (std::abs(goal.xIndex() - start.xIndex()) + 2 * params.margin) / scale + 1;
+  long size_y = (std::abs(goal.yIndex() - start.yIndex()) + 2 * params.margin) / scale + 1;
+  long size_z = params.is_3D ? std::max(1, params.max_altitude - params.min_altitude + 1) : 1;
+  return size_x * size_y * size_z;
+}
+
+// Returns the cost to goal, or infinity if the cell is outside the box or the goal is not reachable
+double HeuristicField::getCostToGoal(const Cell& cell) const {
+  int idx = fieldIndex(cell);
+  if (idx < 0 || dist_[idx] == kUnreachable) {
+    return INFINITY;
+  }
+  if (params_.is_3D) {
+    return dist_[idx];
+  }
+  // The flat field has no vertical edges
+  int dz = goal_.zIndex() - cell.zIndex();
+  double altitude_cost = dz > 0 ? params_.up_cost * dz * step_z_ : -params_.down_cost * dz * step_z_;
+  return dist_[idx] + altitude_cost;
+}
+
+int HeuristicField::fieldIndex(const Cell& cell) const {
+  int i = cell.xIndex() - x0_;
+  int j = cell.yIndex() - y0_;
+  int k = cell.zIndex() - z0_;
+  if (i < 0 || j < 0 || k < 0 || k > params_.max_altitude - params_.min_altitude) {
+    return -1;
+  }
+  i /= params_.scale;
+  j /= params_.scale;
+  if (i >= size_x_ || j >= size_y_) {
+    return -1;
+  }
+  return index(i, j, params_.is_3D ? k : 0);
+}
+
+// The risk of a field cell is the lowest risk of the cells it contains
+void HeuristicField::computeRisks(const RiskFunction& cell_risk, std::vector<float>& risks) const {
+  risks.resize(size_x_ * size_y_ * size_z_);
+  for (int idx = 0; idx < risks.size(); ++idx) {
+    risks[idx] = computeRisk(cell_risk, idx);
+  }
+}
+
+float HeuristicField::computeRisk(const RiskFunction& cell_risk, int idx) const {
+  int scale = params_.scale;
+  int i = idx % size_x_;
+  int j = (idx / size_x_) % size_y_;
+  int k = idx / (size_x_ * size_y_);
+  // The cells of all altitudes are collapsed into the flat field
+  int min_z = params_.is_3D ? z0_ + k : params_.min_altitude;
+  int max_z = params_.is_3D ? std::min(z0_ + k, params_.max_altitude) : params_.max_altitude;
+  float risk = kUnreachable;
+  for (int z = min_z; z <= max_z; ++z) {
+    for (int y = y0_ + j * scale; y < y0_ + (j + 1) * scale; ++y) {
+      for (int x = x0_ + i * scale; x < x0_ + (i + 1) * scale; ++x) {
+        risk = std::min(risk, static_cast<float>(cell_risk(Cell(std::tuple<int, int, int>(x, y, z)))));
+      }
+    }
+  }
+  return risk;
+}
+
+// Lower bound of the cost of going from one field cell to a neighboring one
+double HeuristicField::edgeCost(int from, int to) const {
+  // A unit step into a cell averages its risk with at most three other cells
+  if (risk_[to] >= 3.0 * params_.max_cell_risk) {
+    return INFINITY;
+  }
+  int di = to % size_x_ - from % size_x_;
+  int dj = (to / size_x_) % size_y_ - (from / size_x_) % size_y_;
+  int dk = to / (size_x_ * size_y_) - from / (size_x_ * size_y_);
+  double min_risk = std::min(risk_[from], risk_[to]);
+  if (dk != 0) {
+    double climb_cost = dk > 0 ? params_.up_cost : params_.down_cost;
+    return step_z_ * (climb_cost + params_.risk_factor * min_risk);
+  }
+  double length = step_xy_;
+  if (di != 0 && dj != 0) {
+    // Diagonal steps also pass the corners of the two side cells
+    length *= M_SQRT2;
+    min_risk = std::min(min_risk, static_cast<double>(std::min(risk_[from + di], risk_[from + dj * size_x_])));
+  }
+  return length * (1.0 + params_.risk_factor * min_risk);
+}
+
+// Fills neighbor_cells with the 8 horizontal and 2 vertical neighbors inside the box
+void HeuristicField::neighbors(int idx, std::vector<int>& neighbor_cells) const {
+  neighbor_cells.clear();
+  int i = idx % size_x_;
+  int j = (idx / size_x_) % size_y_;
+  int k = idx / (size_x_ * size_y_);
+  for (int dj = -1; dj <= 1; ++dj) {
+    for (int di = -1; di <= 1; ++di) {
+      if ((di != 0 || dj != 0) && i + di >= 0 && i + di < size_x_ && j + dj >= 0 && j + dj < size_y_) {
+        neighbor_cells.push_back(index(i + di, j + dj, k));
+      }
+    }
+  }
+  if (k > 0) {
+    neighbor_cells.push_back(index(i, j, k - 1));
+  }
+  if (k + 1 < size_z_) {
+    neighbor_cells.push_back(index(i, j, k + 1));
+  }
+}
+
+// Dijkstra backwards from the cells in heap, relaxing the edges into each popped cell
+void HeuristicField::propagate(std::vector<std::pair<float, int> >& heap) {
+  std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int> >,
+                      std::greater<std::pair<float, int> > >
+      pq(std::greater<std::pair<float, int> >(), std::move(heap));
+  std::vector<int> neighbor_cells;
+  while (!pq.empty()) {
+    std::pair<float, int> u_dist = pq.top();
+    pq.pop();
+    int u = u_dist.second;
+    if (u_dist.first > dist_[u]) {
+      continue;  // Stale entry
+    }
+    neighbors(u, neighbor_cells);
+    for (int v : neighbor_cells) {
+      float new_dist = dist_[u] + edgeCost(v, u);
+      if (new_dist < dist_[v]) {
+        dist_[v] = new_dist;
+        next_[v] = u;
+        pq.push(std::make_pair(new_dist, v));
+      }
+    }
+  }
+}
+
+void HeuristicField::computeDistances() {
+  dist_.assign(risk_.size(), kUnreachable);
+  next_.assign(risk_.size(), -1);
+  std::vector<std::pair<float, int> > heap;
+  for (int idx : goal_cells_) {
+    dist_[idx] = 0.0f;
+    heap.push_back(std::make_pair(0.0f, idx));
+  }
+  propagate(heap);
+}
+
+}  // namespace global_planner
@@ -1,5 +1,9 @@
 #include "global_planner/node.h"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+
 namespace global_planner {
 
 bool Node::isSmaller(const Node& other) const {
@@ -22,30 +26,69 @@ std::vector<NodePtr> Node::getNeighbors() const {
   return neighbors;
 }
 
-std::unordered_set<Cell> Node::getCells() const {
-  std::unordered_set<Cell> cells;
-  int dx = cell_.xIndex() - parent_.xIndex();
-  int dy = cell_.yIndex() - parent_.yIndex();
-  int dz = cell_.zIndex() - parent_.zIndex();
+namespace {
+
+// Fills offsets with the cells covered by the edge from parent to cell, relative to parent
+void computeCellOffsets(const Cell& parent, const Cell& cell, std::vector<Cell>& offsets) {
+  offsets.clear();
+  int dx = cell.xIndex() - parent.xIndex();
+  int dy = cell.yIndex() - parent.yIndex();
+  int dz = cell.zIndex() - parent.zIndex();
 
   int steps = 2 * std::max(std::abs(dx), std::max(std::abs(dy), std::abs(dz)));
 
-  double x_step = (cell_.xPos() - parent_.xPos()) / steps;
-  double y_step = (cell_.yPos() - parent_.yPos()) / steps;
-  double z_step = (cell_.zPos() - parent_.zPos()) / steps;
+  double x_step = (cell.xPos() - parent.xPos()) / steps;
+  double y_step = (cell.yPos() - parent.yPos()) / steps;
+  double z_step = (cell.zPos() - parent.zPos()) / steps;
 
   for (int i = 1; i <= steps; ++i) {
-    double new_x = parent_.xPos() + x_step * i;
-    double new_y = parent_.yPos() + y_step * i;
-    double new_z = parent_.zPos() + z_step * i;
-    cells.insert(Cell(new_x + 0.1, new_y + 0.1, new_z));
-    cells.insert(Cell(new_x + 0.1, new_y - 0.1, new_z));
-    cells.insert(Cell(new_x - 0.1, new_y + 0.1, new_z));
-    cells.insert(Cell(new_x - 0.1, new_y - 0.1, new_z));
+    double new_x = parent.xPos() + x_step * i;
+    double new_y = parent.yPos() + y_step * i;
+    double new_z = parent.zPos() + z_step * i;
+    offsets.push_back(Cell(new_x + 0.1, new_y + 0.1, new_z) - parent);
+    offsets.push_back(Cell(new_x + 0.1, new_y - 0.1, new_z) - parent);
+    offsets.push_back(Cell(new_x - 0.1, new_y + 0.1, new_z) - parent);
+    offsets.push_back(Cell(new_x - 0.1, new_y - 0.1, new_z) - parent);
+  }
+  std::sort(offsets.begin(), offsets.end());
+  offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+}
+
+}  // namespace
+
+// The footprint of a unit step doesn't depend on where it starts, so the 27
+// unit steps are computed once. Longer edges reuse a buffer of the thread
+const std::vector<Cell>& getCellOffsets(const Cell& parent, const Cell& cell) {
+  static const std::vector<std::vector<Cell> > unit_step_offsets = []() {
+    std::vector<std::vector<Cell> > table(27);
+    Cell origin(std::tuple<int, int, int>(0, 0, 0));
+    for (int i = 0; i < 27; ++i) {
+      Cell step(std::tuple<int, int, int>(i / 9 - 1, (i / 3) % 3 - 1, i % 3 - 1));
+      computeCellOffsets(origin, step, table[i]);
+    }
+    return table;
+  }();
+  int dx = cell.xIndex() - parent.xIndex();
+  int dy = cell.yIndex() - parent.yIndex();
+  int dz = cell.zIndex() - parent.zIndex();
+  if (std::abs(dx) <= 1 && std::abs(dy) <= 1 && std::abs(dz) <= 1) {
+    return unit_step_offsets[(dx + 1) * 9 + (dy + 1) * 3 + dz + 1];
+  }
+  thread_local std::vector<Cell> offsets;
+  computeCellOffsets(parent, cell, offsets);
+  return offsets;
+}
+
+std::unordered_set<Cell> Node::getCells() const {
+  std::unordered_set<Cell> cells;
+  for (const Cell& offset : getCellOffsets()) {
+    cells.insert(parent_ + offset);
   }
   return cells;
 }
 
+const std::vector<Cell>& Node::getCellOffsets() const { return global_planner::getCellOffsets(parent_, cell_); }
+
 double Node::getLength() const { return parent_.distance3D(cell_); }
 
 // The number of 45 degree turns needed to go to other
@@ -76,6 +119,91 @@ double Node::getXYRotation(const Node& other) const {
   return num_45_deg_turns;
 }
 
+MotionPrimitiveTable::MotionPrimitiveTable(double radius)
+    : radius_(radius), max_step_(std::max(1, static_cast<int>(std::ceil(radius)))), side_(2 * max_step_ + 1) {
+  Cell origin(std::tuple<int, int, int>(0, 0, 0));
+  primitives_.resize(side_ * side_ * side_);
+  for (int i = 0; i < primitives_.size(); ++i) {
+    MotionPrimitive& primitive = primitives_[i];
+    primitive.step = Cell(std::tuple<int, int, int>(i / (side_ * side_) - max_step_, (i / side_) % side_ - max_step_,
+                                                    i % side_ - max_step_));
+    primitive.swept_offsets = global_planner::getCellOffsets(origin, primitive.step);
+    primitive.length = origin.distance3D(primitive.step);
+  }
+
+  // The same successors as SpeedNode::getNeighbors, in the same order
+  successors_.resize(primitives_.size());
+  for (int i = 0; i < primitives_.size(); ++i) {
+    const Cell& velocity = primitives_[i].step;
+    successors_[i].push_back(&primitives_[i]);
+    for (const Cell& step : velocity.getNeighbors()) {
+      double length = origin.distance3D(step);
+      if (length > 0 && length < radius_) {
+        successors_[i].push_back(&primitives_[index(step)]);
+      }
+    }
+  }
+}
+
+const MotionPrimitive* MotionPrimitiveTable::getPrimitive(const Cell& step) const {
+  int i = index(step);
+  return i < 0 ? nullptr : &primitives_[i];
+}
+
+const std::vector<const MotionPrimitive*>* MotionPrimitiveTable::getSuccessors(const Cell& velocity) const {
+  int i = index(velocity);
+  return i < 0 ? nullptr : &successors_[i];
+}
+
+int MotionPrimitiveTable::index(const Cell& step) const {
+  int x = step.xIndex() + max_step_;
+  int y = step.yIndex() + max_step_;
+  int z = step.zIndex() + max_step_;
+  if (x < 0 || y < 0 || z < 0 || x >= side_ || y >= side_ || z >= side_) {
+    return -1;
+  }
+  return (x * side_ + y) * side_ + z;
+}
+
+const MotionPrimitiveTable& getMotionPrimitives(double radius) {
+  static std::mutex tables_mutex;
+  static std::map<double, MotionPrimitiveTable> tables;
+  std::lock_guard<std::mutex> lock(tables_mutex);
+  auto it = tables.find(radius);
+  if (it == tables.end()) {
+    it = tables.emplace(radius, MotionPrimitiveTable(radius)).first;
+  }
+  return it->second;
+}
+
+std::vector<NodePtr> LatticeNode::getNeighbors() const {
+  std::vector<NodePtr> neighbors;
+  const std::vector<const MotionPrimitive*>* successors = primitives_->getSuccessors(cell_ - parent_);
+  if (successors == nullptr) {
+    // Only the start node can be faster than the table, expand it like a SpeedNode
+    Cell extrapolate_cell = (cell_ - parent_) + cell_;
+    neighbors.push_back(nextNode(extrapolate_cell));
+    for (const Cell& neighbor_cell : extrapolate_cell.getNeighbors()) {
+      double dist = cell_.distance3D(neighbor_cell);
+      if (dist > 0 && dist < primitives_->getRadius()) {
+        neighbors.push_back(nextNode(neighbor_cell));
+      }
+    }
+    return neighbors;
+  }
+  neighbors.reserve(successors->size());
+  for (const MotionPrimitive* primitive : *successors) {
+    neighbors.push_back(NodePtr(new LatticeNode(cell_ + primitive->step, cell_, primitives_)));
+  }
+  return neighbors;
+}
+
+const std::vector<Cell>& LatticeNode::getCellOffsets() const {
+  return primitive_ ? primitive_->swept_offsets : Node::getCellOffsets();
+}
+
+double LatticeNode::getLength() const { return primitive_ ? primitive_->length : Node::getLength(); }
+
 std::string Node::asString() const {
   std::string s = "(" + cell_.asString() + " , " + parent_.asString() + ")";
   return s;
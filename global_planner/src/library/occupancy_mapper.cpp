@@ -0,0 +1,94 @@
+#include "global_planner/occupancy_mapper.h"
+
+#include <algorithm>
+
+#include "global_planner/parallel.h"
+
+namespace global_planner {
+
+OccupancyMapper::OccupancyMapper(const OccupancyMapperParameters& params)
+    : params_(params), key_tree_(params.resolution) {}
+
+// Returns a new empty tree with the sensor model of the mapper, the caller owns it
+octomap::OcTree* OccupancyMapper::createTree() const {
+  octomap::OcTree* tree = new octomap::OcTree(params_.resolution);
+  configureTree(tree);
+  return tree;
+}
+
+// Sets the sensor model of the mapper on a tree that was created elsewhere,
+// e.g. read from a file. The sensor model is not part of the serialized tree
+void OccupancyMapper::configureTree(octomap::OcTree* tree) const {
+  tree->setProbHit(params_.prob_hit);
+  tree->setProbMiss(params_.prob_miss);
+  tree->setClampingThresMin(params_.clamping_min);
+  tree->setClampingThresMax(params_.clamping_max);
+}
+
+// Casts a ray from origin to each point. The voxels of the end points are
+// occupied, the voxels the rays pass through are free unless some ray ends there
+void OccupancyMapper::computeUpdate(const octomap::Pointcloud& points, const octomap::point3d& origin,
+                                    OccupancyUpdate& update) const {
+  int num_points = points.size();
+  int num_chunks = std::min(numWorkerThreads(params_.num_threads), num_points / 1000 + 1);
+  std::vector<octomap::KeySet> free_keys(num_chunks);
+  std::vector<octomap::KeySet> occupied_keys(num_chunks);
+
+  parallelFor(num_chunks, num_chunks, [&](int chunk) {
+    octomap::KeyRay ray;
+    octomap::OcTreeKey key;
+    for (int i = chunk * num_points / num_chunks; i < (chunk + 1) * num_points / num_chunks; ++i) {
+      octomap::point3d end = points[i];
+      octomap::point3d direction = end - origin;
+      double range = direction.norm();
+      if (params_.max_range > 0.0 && range > params_.max_range) {
+        end = origin + direction * (params_.max_range / range);
+      } else if (key_tree_.coordToKeyChecked(end, key)) {
+        occupied_keys[chunk].insert(key);
+      }
+      if (key_tree_.computeRayKeys(origin, end, ray)) {
+        free_keys[chunk].insert(ray.begin(), ray.end());
+      }
+    }
+  });
+
+  // Many rays end in the same voxels and pass through the same voxels
+  for (int chunk = 1; chunk < num_chunks; ++chunk) {
+    occupied_keys[0].insert(occupied_keys[chunk].begin(), occupied_keys[chunk].end());
+    free_keys[0].insert(free_keys[chunk].begin(), free_keys[chunk].end());
+  }
+  update.occupied_keys.assign(occupied_keys[0].begin(), occupied_keys[0].end());
+  update.free_keys.clear();
+  update.free_keys.reserve(free_keys[0].size());
+  for (const octomap::OcTreeKey& free_key : free_keys[0]) {
+    if (occupied_keys[0].find(free_key) == occupied_keys[0].end()) {
+      update.free_keys.push_back(free_key);
+    }
+  }
+}
+
+// Integrates the update into tree and adds the cells of the voxels whose
+// occupancy changed to changed_cells. Voxels that are already clamped don't change
+void OccupancyMapper::applyUpdate(const OccupancyUpdate& update, octomap::OcTree* tree,
+                                  std::unordered_set<Cell>& changed_cells) const {
+  auto integrate = [&](const octomap::OcTreeKey& key, bool occupied) {
+    octomap::OcTreeNode* node = tree->search(key);
+    bool is_new = node == nullptr;
+    float old_log_odds = is_new ? 0.0f : node->getLogOdds();
+    // Inner nodes are updated once for the whole cloud
+    node = tree->updateNode(key, occupied, true);
+    if (is_new || node->getLogOdds() != old_log_odds) {
+      octomap::point3d coord = tree->keyToCoord(key);
+      changed_cells.insert(Cell(coord.x(), coord.y(), coord.z()));
+    }
+  };
+  for (const octomap::OcTreeKey& key : update.free_keys) {
+    integrate(key, false);
+  }
+  for (const octomap::OcTreeKey& key : update.occupied_keys) {
+    integrate(key, true);
+  }
+  tree->updateInnerOccupancy();
+}
+
+}  // namespace global_planner
@@ -0,0 +1,99 @@
+#include "global_planner/occupied_cells.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace global_planner {
+
+void OccupiedCells::setLimits(int max_cells, double decay_time) {
+  max_cells_ = std::max(1, max_cells);
+  decay_time_ = std::max(0.0, decay_time);
+}
+
+void OccupiedCells::insert(const Cell& cell, double stamp) {
+  last_seen_[cell] = stamp;
+  if (size() > max_cells_) {
+    prune(stamp, nullptr);
+  }
+}
+
+// Inserts a batch of cells seen at the same time, e.g. the cells of one point cloud
+void OccupiedCells::insert(const std::vector<Cell>& cells, double stamp) { insertBatch(cells, stamp, nullptr); }
+
+// Like insert, changed_cells gets the cells that were not in the store before
+// and the cells that were forgotten
+void OccupiedCells::insert(const std::vector<Cell>& cells, double stamp, std::unordered_set<Cell>& changed_cells) {
+  insertBatch(cells, stamp, &changed_cells);
+}
+
+void OccupiedCells::insertBatch(const std::vector<Cell>& cells, double stamp, std::unordered_set<Cell>* changed_cells) {
+  last_seen_.reserve(std::min<size_t>(last_seen_.size() + cells.size(), max_cells_ + 1));
+  for (const Cell& cell : cells) {
+    auto inserted = last_seen_.insert(std::make_pair(cell, stamp));
+    if (inserted.second) {
+      if (changed_cells) {
+        changed_cells->insert(cell);
+      }
+    } else {
+      inserted.first->second = stamp;
+    }
+  }
+  // Decayed cells are removed a few times per decay_time instead of with every batch
+  bool decay_due = decay_time_ > 0.0 && stamp - last_prune_ > 0.25 * decay_time_;
+  if (size() > max_cells_ || decay_due) {
+    prune(stamp, changed_cells);
+  }
+}
+
+void OccupiedCells::clear() { last_seen_.clear(); }
+
+// Removes the decayed cells, then the oldest cells until there is room for
+// new ones. removed_cells gets the removed cells, if it is set
+void OccupiedCells::prune(double stamp, std::unordered_set<Cell>* removed_cells) {
+  last_prune_ = stamp;
+  auto erase = [&](std::unordered_map<Cell, double>::iterator it) {
+    if (removed_cells) {
+      removed_cells->insert(it->first);
+    }
+    return last_seen_.erase(it);
+  };
+  if (decay_time_ > 0.0) {
+    for (auto it = last_seen_.begin(); it != last_seen_.end();) {
+      it = stamp - it->second > decay_time_ ? erase(it) : std::next(it);
+    }
+  }
+  if (size() <= max_cells_) {
+    return;
+  }
+
+  // Shrink to 90% of max_cells_, so that this doesn't happen with every insert
+  size_t num_kept = 0.9 * max_cells_;
+  std::vector<double> stamps;
+  stamps.reserve(last_seen_.size());
+  for (const auto& cell_stamp : last_seen_) {
+    stamps.push_back(cell_stamp.second);
+  }
+  auto threshold = stamps.end() - num_kept;
+  std::nth_element(stamps.begin(), threshold, stamps.end());
+  double min_stamp = *threshold;
+  size_t num_removed = last_seen_.size() - num_kept;
+  for (auto it = last_seen_.begin(); it != last_seen_.end() && num_removed > 0;) {
+    if (it->second < min_stamp) {
+      it = erase(it);
+      num_removed--;
+    } else {
+      ++it;
+    }
+  }
+  // Cells seen at min_stamp are only removed if there are too many of them
+  for (auto it = last_seen_.begin(); it != last_seen_.end() && num_removed > 0;) {
+    if (it->second == min_stamp) {
+      it = erase(it);
+      num_removed--;
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace global_planner
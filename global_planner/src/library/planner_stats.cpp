@@ -0,0 +1,79 @@
+#include "global_planner/planner_stats.h"
+
+#include <algorithm>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace global_planner {
+
+void PhaseTiming::add(double ms) {
+  count++;
+  total_ms += ms;
+  max_ms = std::max(max_ms, ms);
+}
+
+void PhaseTiming::merge(const PhaseTiming& other) {
+  count += other.count;
+  total_ms += other.total_ms;
+  max_ms = std::max(max_ms, other.max_ms);
+}
+
+void PlannerStats::addSearch(int num_expansions, int open_set_size) {
+  searches++;
+  expansions += num_expansions;
+  max_open_set_size = std::max(max_open_set_size, static_cast<long>(open_set_size));
+}
+
+void PlannerStats::merge(const PlannerStats& other) {
+  risk_cache_hits += other.risk_cache_hits;
+  risk_cache_misses += other.risk_cache_misses;
+  heuristic_evaluations += other.heuristic_evaluations;
+  searches += other.searches;
+  expansions += other.expansions;
+  max_open_set_size = std::max(max_open_set_size, other.max_open_set_size);
+  for (const auto& phase : other.phases) {
+    phases[phase.first].merge(phase.second);
+  }
+}
+
+double PlannerStats::riskCacheHitRate() const {
+  long lookups = risk_cache_hits + risk_cache_misses;
+  return lookups > 0 ? static_cast<double>(risk_cache_hits) / lookups : 0.0;
+}
+
+// Returns the counters and the phase timings as named values, e.g. for diagnostics
+std::vector<std::pair<std::string, double> > PlannerStats::values() const {
+  std::vector<std::pair<std::string, double> > named_values;
+  auto add = [&named_values](const std::string& name, double value) { named_values.push_back({name, value}); };
+  add("risk_cache_hits", risk_cache_hits);
+  add("risk_cache_misses", risk_cache_misses);
+  add("risk_cache_hit_rate", riskCacheHitRate());
+  add("heuristic_evaluations", heuristic_evaluations);
+  add("searches", searches);
+  add("expansions", expansions);
+  add("max_open_set_size", max_open_set_size);
+  for (const auto& phase : phases) {
+    add(phase.first + "_count", phase.second.count);
+    add(phase.first + "_total_ms", phase.second.total_ms);
+    add(phase.first + "_max_ms", phase.second.max_ms);
+  }
+  return named_values;
+}
+
+// Returns the number of bytes allocated with malloc and new, or -1 if unknown
+long heapAllocatedBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+  // The fields are ints and wrap around above 2 GB
+  struct mallinfo info = mallinfo();
+  return static_cast<unsigned int>(info.uordblks) + static_cast<unsigned int>(info.hblkhd);
+#else
+  return -1;
+#endif
+}
+
+}  // namespace global_planner
@@ -0,0 +1,150 @@
+#include "global_planner/site_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace global_planner {
+
+namespace {
+const char kMagic[8] = {'G', 'P', 'S', 'I', 'T', 'E', '0', '1'};
+
+uint64_t alignedSize(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+// True if the section is inside the file, without overflowing on corrupt offsets
+bool isInFile(uint64_t offset, uint64_t size, uint64_t file_size) {
+  return offset <= file_size && size <= file_size - offset;
+}
+
+// Flushes the file or directory to disk
+bool syncPath(const std::string& path, int flags) {
+  int fd = ::open(path.c_str(), flags);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+}  // namespace
+
+struct SiteCacheHeader {
+  char magic[8];
+  SiteCacheKey key;
+  uint64_t octree_offset;
+  uint64_t octree_size;
+  uint64_t risks_offset;
+  uint64_t num_risks;
+  uint64_t field_offset;
+  uint64_t field_size;
+};
+
+bool operator==(const SiteCacheKey& lhs, const SiteCacheKey& rhs) {
+  return lhs.robot_radius == rhs.robot_radius && lhs.octree_resolution == rhs.octree_resolution &&
+         lhs.cell_scale == rhs.cell_scale && lhs.neighbor_risk_flow == rhs.neighbor_risk_flow &&
+         lhs.explore_penalty == rhs.explore_penalty && lhs.alt_prior_sum == rhs.alt_prior_sum;
+}
+
+bool writeSiteCacheFile(const std::string& filename, const SiteCacheKey& key, const std::string& octree,
+                        const std::vector<RiskRecord>& risks, const std::string& heuristic_field) {
+  SiteCacheHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.key = key;
+  header.octree_offset = alignedSize(sizeof(header));
+  header.octree_size = octree.size();
+  header.risks_offset = alignedSize(header.octree_offset + header.octree_size);
+  header.num_risks = risks.size();
+  header.field_offset = alignedSize(header.risks_offset + risks.size() * sizeof(RiskRecord));
+  header.field_size = heuristic_field.size();
+
+  std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+    const char padding[8] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding, header.octree_offset - sizeof(header));
+    out.write(octree.data(), octree.size());
+    out.write(padding, header.risks_offset - header.octree_offset - header.octree_size);
+    out.write(reinterpret_cast<const char*>(risks.data()), risks.size() * sizeof(RiskRecord));
+    out.write(padding, header.field_offset - header.risks_offset - risks.size() * sizeof(RiskRecord));
+    out.write(heuristic_field.data(), heuristic_field.size());
+    out.close();
+    if (!out) {
+      std::remove(tmp_filename.c_str());
+      return false;
+    }
+  }
+  // The data must be on disk before the rename, and the rename before returning
+  if (!syncPath(tmp_filename, O_WRONLY)) {
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  size_t slash = filename.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "." : filename.substr(0, std::max<size_t>(slash, 1));
+  return syncPath(directory, O_RDONLY | O_DIRECTORY);
+}
+
+SiteCacheFile::~SiteCacheFile() { close(); }
+
+bool SiteCacheFile::open(const std::string& filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(SiteCacheHeader))) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = file_stat.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // The mapping stays valid
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  size_ = size;
+
+  // The records are read in place, so their section must be aligned
+  const SiteCacheHeader& h = header();
+  bool complete = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && isInFile(h.octree_offset, h.octree_size, size_) &&
+                  h.risks_offset % alignof(RiskRecord) == 0 && h.risks_offset <= size_ &&
+                  h.num_risks <= (size_ - h.risks_offset) / sizeof(RiskRecord) &&
+                  isInFile(h.field_offset, h.field_size, size_);
+  if (!complete) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SiteCacheFile::close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+const SiteCacheHeader& SiteCacheFile::header() const { return *reinterpret_cast<const SiteCacheHeader*>(data_); }
+const SiteCacheKey& SiteCacheFile::key() const { return header().key; }
+const char* SiteCacheFile::octreeData() const { return data_ + header().octree_offset; }
+size_t SiteCacheFile::octreeSize() const { return header().octree_size; }
+const RiskRecord* SiteCacheFile::risks() const {
+  return reinterpret_cast<const RiskRecord*>(data_ + header().risks_offset);
+}
+size_t SiteCacheFile::numRisks() const { return header().num_risks; }
+const char* SiteCacheFile::heuristicFieldData() const { return data_ + header().field_offset; }
+size_t SiteCacheFile::heuristicFieldSize() const { return header().field_size; }
+
+}  // namespace global_planner
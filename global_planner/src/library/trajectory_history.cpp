@@ -0,0 +1,89 @@
+#include "global_planner/trajectory_history.h"
+
+#include <algorithm>
+
+namespace global_planner {
+
+Cell TrajectoryHistory::Run::cell(int i) const {
+  return Cell(std::tuple<int, int, int>(first.xIndex() + i * step.xIndex(), first.yIndex() + i * step.yIndex(),
+                                        first.zIndex() + i * step.zIndex()));
+}
+
+TrajectoryHistory::ReverseIterator& TrajectoryHistory::ReverseIterator::operator++() {
+  if (--offset_ < 0) {
+    if (--run_ >= 0) {
+      offset_ = (*runs_)[run_].length - 1;
+    } else {
+      offset_ = 0;  // Equal to rend()
+    }
+  }
+  return *this;
+}
+
+void TrajectoryHistory::setMaxSize(int max_cells) {
+  max_cells_ = std::max(1, max_cells);
+  while (size_ > max_cells_) {
+    popFront();
+  }
+}
+
+// Adds the cell after the newest one, extending the newest run if the cell
+// continues it in the same direction
+void TrajectoryHistory::push_back(const Cell& cell) {
+  if (!runs_.empty()) {
+    Run& last = runs_.back();
+    Cell step = cell - last.cell(last.length - 1);
+    if (last.length == 1) {
+      last.step = step;
+      ++last.length;
+    } else if (step == last.step) {
+      ++last.length;
+    } else {
+      runs_.push_back(Run{cell, Cell(std::tuple<int, int, int>(0, 0, 0)), 1});
+    }
+  } else {
+    runs_.push_back(Run{cell, Cell(std::tuple<int, int, int>(0, 0, 0)), 1});
+  }
+  if (++size_ > max_cells_) {
+    popFront();
+  }
+}
+
+// Removes the num_cells newest cells
+void TrajectoryHistory::popBack(int num_cells) {
+  num_cells = std::min(num_cells, size_);
+  size_ -= num_cells;
+  while (num_cells > 0) {
+    Run& last = runs_.back();
+    int removed = std::min(num_cells, last.length);
+    last.length -= removed;
+    num_cells -= removed;
+    if (last.length == 0) {
+      runs_.pop_back();
+    }
+  }
+}
+
+void TrajectoryHistory::clear() {
+  runs_.clear();
+  size_ = 0;
+}
+
+TrajectoryHistory::ReverseIterator TrajectoryHistory::rbegin() const {
+  if (runs_.empty()) {
+    return rend();
+  }
+  return ReverseIterator(runs_, runs_.size() - 1, runs_.back().length - 1);
+}
+
+// Removes the oldest cell
+void TrajectoryHistory::popFront() {
+  Run& first = runs_.front();
+  first.first = first.cell(1);
+  --size_;
+  if (--first.length == 0) {
+    runs_.pop_front();
+  }
+}
+
+}  // namespace global_planner
@@ -5,6 +5,7 @@ namespace global_planner {
 GlobalPlannerNode::GlobalPlannerNode(const ros::NodeHandle& nh, const ros::NodeHandle& nh_private)
     : nh_(nh),
       nh_private_(nh_private),
+      server_(nh_),
       avoidance_node_(nh, nh_private),
       cmdloop_dt_(0.1),
       plannerloop_dt_(1.0),
@@ -16,7 +17,7 @@ GlobalPlannerNode::GlobalPlannerNode(const ros::NodeHandle& nh, const ros::NodeH
   server_.setCallback(f);
 
 #ifndef DISABLE_SIMULATION
-  world_visualizer_.reset(new avoidance::WorldVisualizer(nh_, ros::this_node::getName()));
+  world_visualizer_.reset(new avoidance::WorldVisualizer(nh_, nh_.getNamespace()));
 #endif
 
   avoidance_node_.init();
@@ -24,7 +25,9 @@ GlobalPlannerNode::GlobalPlannerNode(const ros::NodeHandle& nh, const ros::NodeH
   readParams();
 
   // Subscribers
-  octomap_full_sub_ = nh_.subscribe("/octomap_full", 1, &GlobalPlannerNode::octomapFullCallback, this);
+  if (!mapper_) {
+    octomap_full_sub_ = nh_.subscribe("/octomap_full", 1, &GlobalPlannerNode::octomapFullCallback, this);
+  }
   ground_truth_sub_ = nh_.subscribe("/mavros/local_position/pose", 1, &GlobalPlannerNode::positionCallback, this);
   velocity_sub_ = nh_.subscribe("/mavros/local_position/velocity", 1, &GlobalPlannerNode::velocityCallback, this);
   clicked_point_sub_ = nh_.subscribe("/clicked_point", 1, &GlobalPlannerNode::clickedPointCallback, this);
@@ -42,6 +45,7 @@ GlobalPlannerNode::GlobalPlannerNode(const ros::NodeHandle& nh, const ros::NodeH
   mavros_obstacle_free_path_pub_ = nh_.advertise<mavros_msgs::Trajectory>("/mavros/trajectory/generated", 10);
   current_waypoint_publisher_ = nh_.advertise<geometry_msgs::PoseStamped>("/current_setpoint", 10);
   pointcloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>("/cloud_in", 10);
+  diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
 
   actual_path_.header.frame_id = frame_id_;
 
@@ -70,7 +74,18 @@ GlobalPlannerNode::GlobalPlannerNode(const ros::NodeHandle& nh, const ros::NodeH
   start_time_ = ros::Time::now();
 }
 
-GlobalPlannerNode::~GlobalPlannerNode() {}
+GlobalPlannerNode::~GlobalPlannerNode() {
+  printStatsSummary();
+  if (!site_cache_file_.empty()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (global_planner_.saveSiteCache(site_cache_file_)) {
+      ROS_INFO("Saved the map and %d cached risks to %s", (int)global_planner_.risk_cache_.size(),
+               site_cache_file_.c_str());
+    } else {
+      ROS_WARN("Could not save the site cache to %s", site_cache_file_.c_str());
+    }
+  }
+}
 
 // Read Ros parameters
 void GlobalPlannerNode::readParams() {
@@ -88,13 +103,50 @@ void GlobalPlannerNode::readParams() {
   nh_.param<double>("robot_radius", robot_radius, 0.5);
   global_planner_.setFrame(frame_id_);
   global_planner_.setRobotRadius(robot_radius);
+
+  bool use_octomap_mapper;
+  nh_.param<bool>("use_octomap_mapper", use_octomap_mapper, false);
+  OccupancyMapperParameters mapper_params;
+  if (use_octomap_mapper) {
+    nh_.param<double>("mapper/resolution", mapper_params.resolution, 1.0);
+    nh_.param<double>("mapper/max_range", mapper_params.max_range, 9.0);
+    nh_.param<double>("mapper/hit", mapper_params.prob_hit, 0.9);
+    nh_.param<double>("mapper/miss", mapper_params.prob_miss, 0.45);
+    nh_.param<double>("mapper/min", mapper_params.clamping_min, 0.01);
+    nh_.param<double>("mapper/max", mapper_params.clamping_max, 0.99);
+    nh_.param<int>("mapper/threads", mapper_params.num_threads, 0);
+    mapper_.reset(new OccupancyMapper(mapper_params));
+    global_planner_.updateFullOctomap(mapper_->createTree());
+  }
+
+  // A flat copy of each /octomap_full map for the risk lookups, optionally
+  // written to flat_map_file for other processes
+  nh_.param<bool>("use_flat_map", use_flat_map_, false);
+  nh_.param<std::string>("flat_map_file", flat_map_file_, "");
+
+  // The map of an earlier mission over the same site. Without the built-in
+  // mapper, the first /octomap_full message replaces it
+  nh_.param<std::string>("site_cache_file", site_cache_file_, "");
+  if (!site_cache_file_.empty() && global_planner_.loadSiteCache(site_cache_file_) && mapper_) {
+    if (global_planner_.octree_->getResolution() != mapper_params.resolution) {
+      ROS_WARN("The map of %s has a different resolution than the mapper, starting with an empty map",
+               site_cache_file_.c_str());
+      global_planner_.updateFullOctomap(mapper_->createTree());
+    } else {
+      mapper_->configureTree(global_planner_.octree_);
+    }
+  }
 }
 
 void GlobalPlannerNode::initializeCameraSubscribers(std::vector<std::string>& camera_topics) {
   cameras_.resize(camera_topics.size());
 
   for (size_t i = 0; i < camera_topics.size(); i++) {
-    cameras_[i].pointcloud_sub_ = nh_.subscribe(camera_topics[i], 1, &GlobalPlannerNode::depthCameraCallback, this);
+    cameras_[i].pointcloud_sub_.reset(
+        new message_filters::Subscriber<sensor_msgs::PointCloud2>(nh_, camera_topics[i], 1));
+    cameras_[i].pointcloud_filter_.reset(
+        new tf::MessageFilter<sensor_msgs::PointCloud2>(*cameras_[i].pointcloud_sub_, listener_, frame_id_, 10));
+    cameras_[i].pointcloud_filter_->registerCallback(boost::bind(&GlobalPlannerNode::depthCameraCallback, this, _1));
   }
 }
 
@@ -126,7 +178,11 @@ void GlobalPlannerNode::planPath() {
     ROS_INFO("OctoMap memory usage: %2.3f MB", global_planner_.octree_->memoryUsage() / 1000000.0);
   }
 
-  bool found_path = global_planner_.getGlobalPath();
+  bool found_path = false;
+  {
+    ScopedPhaseTimer timer(global_planner_.stats_, "getGlobalPath");
+    found_path = global_planner_.getGlobalPath();
+  }
 
   if (!found_path) {
     // TODO: popNextGoal(), instead of checking if goal_is_blocked in
@@ -170,6 +226,33 @@ void GlobalPlannerNode::dynamicReconfigureCallback(global_planner::GlobalPlanner
   global_planner_.use_current_yaw_ = config.use_current_yaw_;
   global_planner_.use_risk_heuristics_ = config.use_risk_heuristics_;
   global_planner_.use_speedup_heuristics_ = config.use_speedup_heuristics_;
+  global_planner_.use_heuristic_field_ = config.use_heuristic_field_;
+  global_planner_.heuristic_field_3d_ = config.heuristic_field_3d_;
+  global_planner_.heuristic_field_scale_ = config.heuristic_field_scale_;
+  global_planner_.heuristic_field_margin_ = config.heuristic_field_margin_;
+  global_planner_.use_hierarchical_planning_ = config.use_hierarchical_planning_;
+  global_planner_.hierarchy_levels_ = config.hierarchy_levels_;
+  global_planner_.corridor_width_ = config.corridor_width_;
+  global_planner_.occupied_.setLimits(config.occupied_max_cells_, config.occupied_decay_time_);
+  global_planner_.use_any_angle_search_ = config.use_any_angle_search_;
+  global_planner_.use_bidirectional_search_ = config.use_bidirectional_search_;
+  global_planner_.use_bidirectional_threads_ = config.use_bidirectional_threads_;
+  global_planner_.use_portfolio_search_ = config.use_portfolio_search_;
+  global_planner_.portfolio_deadline_ = config.portfolio_deadline_;
+  global_planner_.portfolio_threads_ = config.portfolio_threads_;
+  global_planner_.use_path_watchdog_ = config.use_path_watchdog_;
+  global_planner_.max_path_deviation_ = config.max_path_deviation_;
+  global_planner_.use_mission_planning_ = config.use_mission_planning_;
+  global_planner_.mission_threads_ = config.mission_threads_;
+  global_planner_.risk_query_threads_ = config.risk_query_threads_;
+  {
+    // The planner loop and its mission workers use the legs and the
+    // trajectory history on the planner thread
+    std::lock_guard<std::mutex> lock(mutex_);
+    global_planner_.path_back_.setMaxSize(config.path_back_max_cells_);
+    global_planner_.path_is_valid_ = false;  // Replan with the new parameters
+    global_planner_.mission_legs_.clear();
+  }
 
   // global_planner_node
   clicked_goal_alt_ = config.clicked_goal_alt_;
@@ -197,7 +280,11 @@ void GlobalPlannerNode::velocityCallback(const geometry_msgs::TwistStamped& msg)
 void GlobalPlannerNode::positionCallback(const geometry_msgs::PoseStamped& msg) {
   // Update position
   last_pos_ = msg;
-  global_planner_.setPose(last_pos_);
+  {
+    // The planner loop reads the position and the trajectory history on its own thread
+    std::lock_guard<std::mutex> lock(mutex_);
+    global_planner_.setPose(last_pos_);
+  }
 
   // Check if a new goal is needed
   if (num_pos_msg_++ % 10 == 0) {
@@ -231,7 +318,10 @@ void GlobalPlannerNode::positionCallback(const geometry_msgs::PoseStamped& msg)
 }
 
 void GlobalPlannerNode::clickedPointCallback(const geometry_msgs::PointStamped& msg) {
-  printPointInfo(msg.point.x, msg.point.y, msg.point.z);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    printPointInfo(msg.point.x, msg.point.y, msg.point.z);
+  }
 
   geometry_msgs::PoseStamped pose;
   pose.header = msg.header;
@@ -254,45 +344,118 @@ void GlobalPlannerNode::fcuInputGoalCallback(const mavros_msgs::Trajectory& msg)
 
 // Check if the current path is blocked
 void GlobalPlannerNode::octomapFullCallback(const octomap_msgs::Octomap& msg) {
-  std::lock_guard<std::mutex> lock(mutex_);
-
-  ros::Time current = ros::Time::now();
-  // Update map at a fixed rate. This is useful on setting replanning rates for the planner.
-  if ((current - last_wp_time_).toSec() < mapupdate_dt_) {
-    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ros::Time current = ros::Time::now();
+    // Update map at a fixed rate. This is useful on setting replanning rates for the planner.
+    if ((current - last_wp_time_).toSec() < mapupdate_dt_) {
+      return;
+    }
+    last_wp_time_ = ros::Time::now();
   }
-  last_wp_time_ = ros::Time::now();
 
+  // The map is deserialized and flattened without holding mutex_, the planner
+  // keeps planning on the previous map meanwhile
   octomap::AbstractOcTree* tree = octomap_msgs::msgToMap(msg);
+  octomap::OcTree* octree = dynamic_cast<octomap::OcTree*>(tree);
+  std::shared_ptr<FlatMap> flat_map;
+  if (use_flat_map_ && octree) {
+    flat_map = std::make_shared<FlatMap>();
+    flat_map->build(*octree);
+    // Plan with the mapped file, its pages are shared with the other processes that read it
+    if (!flat_map_file_.empty() && flat_map->write(flat_map_file_) && !flat_map->open(flat_map_file_)) {
+      flat_map->build(*octree);
+    }
+  }
 
+  std::lock_guard<std::mutex> lock(mutex_);
   global_planner_.updateFullOctomap(tree);
+  global_planner_.flat_map_ = flat_map;
 }
 
-// Go through obstacle points and store them
-void GlobalPlannerNode::depthCameraCallback(const sensor_msgs::PointCloud2& msg) {
+// Go through obstacle points and store them. The message filter only calls
+// this when the transform of the cloud is available
+void GlobalPlannerNode::depthCameraCallback(const sensor_msgs::PointCloud2::ConstPtr& msg) {
   try {
     // Transform msg from camera frame to world frame
-    ros::Time now = ros::Time::now();
-    listener_.waitForTransform(frame_id_, "/camera_link", now, ros::Duration(5.0));
     tf::StampedTransform transform;
-    listener_.lookupTransform(frame_id_, "/camera_link", now, transform);
-    sensor_msgs::PointCloud2 transformed_msg;
-    pcl_ros::transformPointCloud(frame_id_, transform, msg, transformed_msg);
-    pcl::PointCloud<pcl::PointXYZ> cloud;  // Easier to loop through pcl::PointCloud
-    pcl::fromROSMsg(transformed_msg, cloud);
-
-    // Store the obstacle points
-    for (const auto& p : cloud) {
-      if (!std::isnan(p.x)) {
-        // TODO: Not all points end up here
-        Cell occupied_cell(p.x, p.y, p.z);
-        global_planner_.occupied_.insert(occupied_cell);
+    listener_.lookupTransform(frame_id_, msg->header.frame_id, msg->header.stamp, transform);
+
+    // Read the points straight from the message, it may be shared with the
+    // other nodelets of the manager and is not copied
+    std::vector<Cell> occupied_cells;
+    occupied_cells.reserve(msg->width * msg->height);
+    octomap::Pointcloud points;
+    sensor_msgs::PointCloud2ConstIterator<float> iter_x(*msg, "x");
+    sensor_msgs::PointCloud2ConstIterator<float> iter_y(*msg, "y");
+    sensor_msgs::PointCloud2ConstIterator<float> iter_z(*msg, "z");
+    for (; iter_x != iter_x.end(); ++iter_x, ++iter_y, ++iter_z) {
+      if (!std::isnan(*iter_x)) {
+        tf::Vector3 p = transform * tf::Vector3(*iter_x, *iter_y, *iter_z);
+        occupied_cells.push_back(Cell(p.x(), p.y(), p.z()));
+        if (mapper_) {
+          points.push_back(p.x(), p.y(), p.z());
+        }
       }
     }
-    pointcloud_pub_.publish(msg);
+
+    // Many points fall in the same cell, only store each cell once
+    std::sort(occupied_cells.begin(), occupied_cells.end());
+    occupied_cells.erase(std::unique(occupied_cells.begin(), occupied_cells.end()), occupied_cells.end());
+
+    // The rays are cast without holding mutex_
+    OccupancyUpdate map_update;
+    if (mapper_) {
+      const tf::Vector3& origin = transform.getOrigin();
+      mapper_->computeUpdate(points, octomap::point3d(origin.x(), origin.y(), origin.z()), map_update);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(pending_cells_mutex_);
+      pending_occupied_cells_.push_back(std::make_pair(msg->header.stamp.toSec(), std::move(occupied_cells)));
+      if (mapper_) {
+        pending_map_updates_.push_back(std::move(map_update));
+      }
+    }
+    // If the planner is searching, the observations are added before its next search
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (lock.owns_lock()) {
+      addPendingObservations();
+    }
+    if (!mapper_) {
+      pointcloud_pub_.publish(msg);  // Input of the octomap server
+    }
   } catch (tf::TransformException const& ex) {
     ROS_DEBUG("%s", ex.what());
-    ROS_WARN("Transformation not available (%s to /camera_link", frame_id_);
+    ROS_WARN("Transformation not available (%s to %s)", frame_id_.c_str(), msg->header.frame_id.c_str());
+  }
+}
+
+// Moves the observations from the point clouds received since the last call
+// to the planner, mutex_ must be held
+void GlobalPlannerNode::addPendingObservations() {
+  std::vector<std::pair<double, std::vector<Cell> > > pending_cells;
+  std::vector<OccupancyUpdate> pending_updates;
+  {
+    std::lock_guard<std::mutex> lock(pending_cells_mutex_);
+    pending_cells.swap(pending_occupied_cells_);
+    pending_updates.swap(pending_map_updates_);
+  }
+  // A cell that becomes occupied loses the explore penalty and a forgotten
+  // cell gets it back, so the cached risks that read them are invalidated
+  // along with those of the map changes
+  std::unordered_set<Cell> changed_cells;
+  for (const auto& stamped_cells : pending_cells) {
+    global_planner_.occupied_.insert(stamped_cells.second, stamped_cells.first, changed_cells);
+  }
+  for (const OccupancyUpdate& update : pending_updates) {
+    mapper_->applyUpdate(update, global_planner_.octree_, changed_cells);
+  }
+  if (!pending_updates.empty()) {
+    global_planner_.updateOctomapCells(changed_cells);
+    last_wp_time_ = ros::Time::now();  // The map is up to date, like after an /octomap_full message
+  } else {
+    global_planner_.invalidateRisks(changed_cells);
   }
 }
 
@@ -326,12 +489,24 @@ void GlobalPlannerNode::cmdLoopCallback(const ros::TimerEvent& event) {
 
 void GlobalPlannerNode::plannerLoopCallback(const ros::TimerEvent& event) {
   std::lock_guard<std::mutex> lock(mutex_);
+  global_planner_.stats_ = PlannerStats();
+  addPendingObservations();
   bool is_in_goal = global_planner_.goal_pos_.withinPositionRadius(global_planner_.curr_pos_);
+  bool path_is_ready = false;
   if (is_in_goal || global_planner_.goal_is_blocked_) {
     popNextGoal();
+    // The path to the next waypoint may have been planned ahead, then there is no need to wait for a search
+    path_is_ready = global_planner_.use_mission_planning_ && global_planner_.useMissionLeg();
   }
 
-  planPath();
+  if (!path_is_ready) {
+    if (global_planner_.use_path_watchdog_ && global_planner_.isCurrentPathValid()) {
+      planMission();
+      publishDiagnostics();
+      return;  // Republishing the same path would only restart following it
+    }
+    planPath();
+  }
 
   // Print and publish info
   if (is_in_goal && !waypoints_.empty()) {
@@ -342,6 +517,17 @@ void GlobalPlannerNode::plannerLoopCallback(const ros::TimerEvent& event) {
   }
 
   publishPath();
+  planMission();
+  publishDiagnostics();
+}
+
+// Keeps the paths between the remaining waypoints ready for when the current goal is reached
+void GlobalPlannerNode::planMission() {
+  if (!global_planner_.use_mission_planning_) {
+    global_planner_.mission_legs_.clear();
+    return;
+  }
+  global_planner_.planMission(waypoints_);
 }
 
 // Publish the position of goal
@@ -359,20 +545,88 @@ void GlobalPlannerNode::publishGoal(const GoalCell& goal) {
 
 // Publish the current path
 void GlobalPlannerNode::publishPath() {
-  auto path_msg = global_planner_.getPathMsg();
-  PathWithRiskMsg risk_msg = global_planner_.getPathWithRiskMsg();
+  PlannerStats& stats = global_planner_.stats_;
+  nav_msgs::Path path_msg;
+  {
+    ScopedPhaseTimer timer(stats, "path_messages");
+    path_msg = global_planner_.getPathMsg();
+  }
   // Always publish as temporary to remove any obsolete temporary path
   global_temp_path_pub_.publish(path_msg);
   setCurrentPath(path_msg.poses);
-  smooth_path_pub_.publish(smoothPath(path_msg));
+  {
+    ScopedPhaseTimer timer(stats, "smoothPath");
+    smooth_path_pub_.publish(smoothPath(path_msg));
+  }
+  if (global_planner_.use_any_angle_search_) {
+    return;  // The path is already made of straight lines
+  }
 
-  auto simple_path = simplifyPath(&global_planner_, global_planner_.curr_path_, simplify_iterations_, simplify_margin_);
-  auto simple_path_msg = global_planner_.getPathMsg(simple_path);
+  std::vector<Cell> simple_path;
+  {
+    ScopedPhaseTimer timer(stats, "simplifyPath");
+    simple_path = simplifyPath(&global_planner_, global_planner_.curr_path_, simplify_iterations_, simplify_margin_);
+  }
+  nav_msgs::Path simple_path_msg;
+  {
+    ScopedPhaseTimer timer(stats, "path_messages");
+    simple_path_msg = global_planner_.getPathMsg(simple_path);
+  }
   global_temp_path_pub_.publish(simple_path_msg);
   setCurrentPath(simple_path_msg.poses);
+  ScopedPhaseTimer timer(stats, "smoothPath");
   smooth_path_pub_.publish(smoothPath(simple_path_msg));
 }
 
+// Publishes the work of the last planner loop and adds it to the totals
+void GlobalPlannerNode::publishDiagnostics() {
+  const PlannerStats& stats = global_planner_.stats_;
+  total_stats_.merge(stats);
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = "global_planner: planner loop";
+  status.hardware_id = "global_planner";
+  status.message = "Expanded " + std::to_string(stats.expansions) + " nodes in " + std::to_string(stats.searches) +
+                   " searches";
+  std::vector<std::pair<std::string, double> > values = stats.values();
+  values.push_back(std::make_pair("risk_cache_size", global_planner_.risk_cache_.size()));
+  values.push_back(std::make_pair("heap_bytes", heapAllocatedBytes()));
+  if (global_planner_.octree_) {
+    values.push_back(std::make_pair("octomap_bytes", global_planner_.octree_->memoryUsage()));
+  }
+  for (const auto& value : values) {
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = value.first;
+    key_value.value = std::to_string(value.second);
+    status.values.push_back(key_value);
+  }
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  msg.status.push_back(status);
+  diagnostics_pub_.publish(msg);
+}
+
+// Prints the work of all the planner loops, the phases sorted by their total time
+void GlobalPlannerNode::printStatsSummary() {
+  const PlannerStats& stats = total_stats_;
+  ROS_INFO("Global planner summary: %ld searches, %ld expansions, %ld heuristic evaluations, max open set %ld",
+           stats.searches, stats.expansions, stats.heuristic_evaluations, stats.max_open_set_size);
+  ROS_INFO("  risk cache: %ld hits, %ld misses (hit rate %2.1f%%), %d cells", stats.risk_cache_hits,
+           stats.risk_cache_misses, 100.0 * stats.riskCacheHitRate(), (int)global_planner_.risk_cache_.size());
+  std::vector<std::pair<std::string, PhaseTiming> > phases(stats.phases.begin(), stats.phases.end());
+  std::sort(phases.begin(), phases.end(),
+            [](const std::pair<std::string, PhaseTiming>& a, const std::pair<std::string, PhaseTiming>& b) {
+              return a.second.total_ms > b.second.total_ms;
+            });
+  for (const auto& phase : phases) {
+    ROS_INFO("  %-16s %6ld runs, total %9.1f ms, average %7.2f ms, max %7.2f ms", phase.first.c_str(),
+             phase.second.count, phase.second.total_ms, phase.second.total_ms / phase.second.count,
+             phase.second.max_ms);
+  }
+}
+
 // Prints information about the point, mostly the risk of the containing cell
 void GlobalPlannerNode::printPointInfo(double x, double y, double z) {
   // Update explored cells
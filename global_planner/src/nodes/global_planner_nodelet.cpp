@@ -0,0 +1,15 @@
+#include "global_planner/global_planner_nodelet.h"
+
+namespace global_planner {
+
+void GlobalPlannerNodelet::onInit() {
+  NODELET_DEBUG("Initializing nodelet...");
+  // Same roles as in global_planner_node_main: nh is the private handle. The
+  // single-threaded handles serialize the callbacks as the spinner of the node does
+  global_planner_node_.reset(new GlobalPlannerNode(getPrivateNodeHandle(), getNodeHandle()));
+}
+
+}  // namespace global_planner
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(global_planner::GlobalPlannerNodelet, nodelet::Nodelet);
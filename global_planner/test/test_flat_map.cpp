@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "global_planner/flat_map.h"
+
+using namespace global_planner;
+
+class FlatMapTests : public ::testing::Test {
+ public:
+  octomap::OcTree tree = octomap::OcTree(0.5);
+
+  // Use this method to set up any state that you need for all of your tests
+  void SetUp() override {
+    // GIVEN: a uniform free block that is pruned to a few large leaves
+    for (double x = 0.25; x < 8.0; x += 0.5) {
+      for (double y = 0.25; y < 8.0; y += 0.5) {
+        for (double z = 0.25; z < 8.0; z += 0.5) {
+          tree.setNodeValue(x, y, z, -2.0f, true);
+        }
+      }
+    }
+    // AND: scattered cells of different occupancy, with unknown space between them
+    std::default_random_engine generator(10);
+    std::uniform_real_distribution<double> distribution_position(-6.0, 0.0);
+    std::uniform_real_distribution<float> distribution_log_odds(-2.0f, 3.5f);
+    for (int i = 0; i < 500; ++i) {
+      tree.setNodeValue(distribution_position(generator), distribution_position(generator),
+                        distribution_position(generator), distribution_log_odds(generator), true);
+    }
+    tree.updateInnerOccupancy();
+    tree.prune();
+  }
+
+  // Compares FlatMap::search with OcTree::search at several depths over the
+  // explored space and the unknown space around it
+  void expectSameSearch(const FlatMap& flat_map) {
+    for (unsigned depth : {0u, 16u, 15u, 14u, 13u, 12u, 10u}) {
+      for (double x = -7.1; x < 9.0; x += 0.3) {
+        for (double y = -7.1; y < 9.0; y += 0.7) {
+          for (double z = -7.1; z < 9.0; z += 0.7) {
+            octomap::OcTreeNode* node = tree.search(x, y, z, depth);
+            float log_odds = NAN;
+            bool found = flat_map.search(x, y, z, depth, log_odds);
+            ASSERT_EQ(node != nullptr, found) << x << " " << y << " " << z << " depth " << depth;
+            if (node) {
+              ASSERT_FLOAT_EQ(node->getLogOdds(), log_odds) << x << " " << y << " " << z << " depth " << depth;
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+TEST_F(FlatMapTests, searchMatchesOcTree) {
+  // WHEN: we build a flat map of the tree
+  FlatMap flat_map;
+  flat_map.build(tree);
+
+  // THEN: it has the leaves of the tree and the same search results
+  EXPECT_TRUE(flat_map.isValid());
+  EXPECT_EQ(tree.getNumLeafNodes(), flat_map.size());
+  EXPECT_DOUBLE_EQ(tree.getResolution(), flat_map.getResolution());
+  expectSameSearch(flat_map);
+}
+
+TEST_F(FlatMapTests, mappedFileMatchesOcTree) {
+  // GIVEN: a flat map written to a file
+  const std::string filename = "/tmp/global_planner_test_flat_map.bin";
+  FlatMap built_map;
+  built_map.build(tree);
+  ASSERT_TRUE(built_map.write(filename));
+
+  // WHEN: another map opens the file
+  FlatMap mapped_map;
+  ASSERT_TRUE(mapped_map.open(filename));
+  std::remove(filename.c_str());  // The mapping stays valid
+
+  // THEN: it has the same search results
+  EXPECT_EQ(built_map.memoryUsage(), mapped_map.memoryUsage());
+  expectSameSearch(mapped_map);
+}
+
+TEST_F(FlatMapTests, openRejectsIncompleteFile) {
+  // GIVEN: a file with only the start of a flat map
+  const std::string filename = "/tmp/global_planner_test_flat_map_truncated.bin";
+  FILE* file = std::fopen(filename.c_str(), "wb");
+  ASSERT_NE(nullptr, file);
+  std::fputs("GPFLAT01", file);
+  std::fclose(file);
+
+  // THEN: the map is not opened
+  FlatMap flat_map;
+  EXPECT_FALSE(flat_map.open(filename));
+  EXPECT_FALSE(flat_map.isValid());
+  std::remove(filename.c_str());
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <tuple>
+
+#include "global_planner/global_planner.h"
+#include "global_planner/search_tools.h"
+
+using namespace global_planner;
+
+class GlobalPlannerTests : public ::testing::Test {
+ public:
+  GlobalPlanner planner;
+  octomap::OcTree* tree = new octomap::OcTree(1.0);
+
+  // Use this method to set up any state that you need for all of your tests
+  void SetUp() override {
+    // GIVEN: a planner with an explored free map, where the risk of a cell
+    // only depends on the cell itself
+    for (int x = -2; x < 12; ++x) {
+      for (int y = -2; y < 12; ++y) {
+        for (int z = 1; z < 10; ++z) {
+          tree->setNodeValue(x + 0.5, y + 0.5, z + 0.5, -2.0f, true);
+        }
+      }
+    }
+    planner.setRobotRadius(0.5);
+    planner.neighbor_risk_flow_ = 0.0;
+    planner.updateFullOctomap(tree);
+  }
+
+  void TearDown() override { delete planner.octree_; }
+
+  static Cell makeCell(int x, int y, int z) { return Cell(std::tuple<int, int, int>(x, y, z)); }
+
+  void addObstacle(int x, int y, int z) {
+    std::unordered_set<Cell> changed_cells = {makeCell(x, y, z)};
+    tree->setNodeValue(x + 0.5, y + 0.5, z + 0.5, 3.5f, true);
+    planner.updateOctomapCells(changed_cells);
+  }
+};
+
+TEST_F(GlobalPlannerTests, lineOfSightInFreeSpace) {
+  // THEN: straight and diagonal lines are not blocked
+  EXPECT_TRUE(planner.isLineOfSight(makeCell(0, 0, 2), makeCell(8, 3, 2)));
+  EXPECT_TRUE(planner.isLineOfSight(makeCell(0, 0, 2), makeCell(6, 6, 2)));
+  EXPECT_TRUE(planner.isLineOfSight(makeCell(0, 0, 2), makeCell(5, 5, 7)));
+}
+
+TEST_F(GlobalPlannerTests, lineOfSightBetweenDiagonalObstacles) {
+  // GIVEN: two diagonally adjacent obstacles
+  addObstacle(3, 4, 2);
+  addObstacle(4, 3, 2);
+
+  // THEN: the diagonal line between them is blocked in both directions
+  EXPECT_FALSE(planner.isLineOfSight(makeCell(0, 0, 2), makeCell(6, 6, 2)));
+  EXPECT_FALSE(planner.isLineOfSight(makeCell(6, 6, 2), makeCell(0, 0, 2)));
+
+  // AND: a line next to them is not
+  EXPECT_TRUE(planner.isLineOfSight(makeCell(0, 1, 2), makeCell(2, 8, 2)));
+}
+
+TEST_F(GlobalPlannerTests, lineOfSightPastCorner) {
+  // GIVEN: one obstacle at a corner the diagonal line passes
+  addObstacle(3, 4, 2);
+
+  // THEN: the line is blocked in both directions
+  EXPECT_FALSE(planner.isLineOfSight(makeCell(0, 0, 2), makeCell(6, 6, 2)));
+  EXPECT_FALSE(planner.isLineOfSight(makeCell(6, 6, 2), makeCell(0, 0, 2)));
+}
+
+TEST_F(GlobalPlannerTests, lineOfSightPast3DCorner) {
+  // GIVEN: an obstacle that the 3D diagonal line touches at a corner
+  addObstacle(2, 3, 5);
+
+  // THEN: the line is blocked in both directions
+  EXPECT_FALSE(planner.isLineOfSight(makeCell(0, 0, 2), makeCell(5, 5, 7)));
+  EXPECT_FALSE(planner.isLineOfSight(makeCell(5, 5, 7), makeCell(0, 0, 2)));
+}
+
+TEST_F(GlobalPlannerTests, occupiedCellInvalidatesCachedRisks) {
+  // GIVEN: cached risks of a free cell and its neighbor
+  planner.neighbor_risk_flow_ = 1.0;
+  Cell cell = makeCell(4, 4, 3);
+  Cell neighbor = makeCell(5, 4, 3);
+  double cell_risk = planner.getRisk(cell);
+  double neighbor_risk = planner.getRisk(neighbor);
+
+  // WHEN: an obstacle point is seen in the cell
+  std::unordered_set<Cell> changed_cells;
+  planner.occupied_.insert(std::vector<Cell>{cell}, 1.0, changed_cells);
+  planner.invalidateRisks(changed_cells);
+
+  // THEN: the cell is no longer explored free space, which raises both risks
+  EXPECT_EQ(1, changed_cells.size());
+  EXPECT_GT(planner.getRisk(cell), 10.0 * cell_risk);
+  EXPECT_GT(planner.getRisk(neighbor), 10.0 * neighbor_risk);
+}
+
+TEST_F(GlobalPlannerTests, decayedCellInvalidatesCachedRisk) {
+  // GIVEN: the cached risk of an occupied cell
+  planner.occupied_.setLimits(1000, 10.0);
+  Cell cell = makeCell(4, 4, 3);
+  std::unordered_set<Cell> changed_cells;
+  planner.occupied_.insert(std::vector<Cell>{cell}, 1.0, changed_cells);
+  planner.invalidateRisks(changed_cells);
+  double occupied_risk = planner.getRisk(cell);
+
+  // WHEN: the cell is not seen again for longer than the decay time
+  changed_cells.clear();
+  planner.occupied_.insert(std::vector<Cell>{makeCell(9, 9, 3)}, 20.0, changed_cells);
+  planner.invalidateRisks(changed_cells);
+
+  // THEN: the cell is forgotten and its risk has the explore penalty again
+  EXPECT_FALSE(planner.occupied_.contains(cell));
+  EXPECT_TRUE(changed_cells.count(cell));
+  EXPECT_LT(planner.getRisk(cell), 0.1 * occupied_risk);
+}
+
+TEST_F(GlobalPlannerTests, threadedSearchOfWorkerUsesSharedPlanner) {
+  // GIVEN: a wall of cells that have been seen occupied, but are free in the map
+  std::unordered_set<Cell> changed_cells;
+  std::vector<Cell> wall;
+  for (int y = 1; y < 4; ++y) {
+    for (int z = 1; z < 10; ++z) {
+      wall.push_back(makeCell(5, y, z));
+    }
+  }
+  planner.occupied_.insert(wall, 1.0, changed_cells);
+  planner.invalidateRisks(changed_cells);
+
+  // AND: a worker that shares the caches and occupied cells of the planner, like a mission worker
+  GlobalPlanner worker;
+  worker.copySearchParameters(planner);
+  worker.shared_planner_ = &planner;
+  worker.overestimate_factor_ = 1.0;
+  Cell start = makeCell(2, 2, 3);
+  GoalCell goal(makeCell(8, 2, 3));
+  worker.goal_pos_ = goal;
+
+  // WHEN: the worker searches with two threads, and then with one
+  std::vector<Cell> threaded_path;
+  std::vector<Cell> path;
+  SearchInfo threaded_info = findSmoothPathBidirectional(&worker, threaded_path, start, start, goal, 100000, true);
+  SearchInfo info = findSmoothPathBidirectional(&worker, path, start, start, goal, 100000, false);
+
+  // THEN: both searches use the same risks, and find paths of the same cost around the wall
+  ASSERT_TRUE(info.found_path);
+  ASSERT_TRUE(threaded_info.found_path);
+  EXPECT_TRUE(std::find(threaded_path.begin(), threaded_path.end(), makeCell(5, 2, 3)) == threaded_path.end());
+  EXPECT_NEAR(planner.getPathInfo(path).cost, planner.getPathInfo(threaded_path).cost, 1e-3);
+}
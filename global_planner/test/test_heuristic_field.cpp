@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "global_planner/heuristic_field.h"
+
+using namespace global_planner;
+
+class HeuristicFieldTests : public ::testing::Test {
+ public:
+  HeuristicFieldParameters params;
+  GoalCell goal = GoalCell(Cell(std::tuple<int, int, int>(14, 3, 2)), 3.0);
+  Cell start = Cell(std::tuple<int, int, int>(0, 0, 2));
+  std::unordered_map<Cell, double> base_risk;  // Cells that are not in the map have kLowRisk
+  std::default_random_engine generator = std::default_random_engine(5);
+  long num_risk_evaluations = 0;
+
+  const double kLowRisk = 0.001;
+
+  // Use this method to set up any state that you need for all of your tests
+  void SetUp() override {
+    params.min_altitude = 1;
+    params.max_altitude = 5;
+    params.margin = 4;
+    params.scale = 1;
+    params.is_3D = true;
+    params.risk_factor = 500.0;
+    params.up_cost = 3.0;
+    params.down_cost = 1.0;
+    params.max_cell_risk = 0.2;
+
+    // GIVEN: a wall with a gap, and some cells of medium risk
+    for (int y = -4; y < 6; ++y) {
+      for (int z = 1; z <= 5; ++z) {
+        if (y != 4 || z > 3) {
+          base_risk[Cell(std::tuple<int, int, int>(7, y, z))] = 1.0;
+        }
+      }
+    }
+    for (int i = 0; i < 40; ++i) {
+      base_risk[randomCell()] = 0.05;
+    }
+  }
+
+  Cell randomCell() {
+    std::uniform_int_distribution<int> x_distribution(-4, 18);
+    std::uniform_int_distribution<int> y_distribution(-4, 7);
+    std::uniform_int_distribution<int> z_distribution(1, 5);
+    return Cell(std::tuple<int, int, int>(x_distribution(generator), y_distribution(generator),
+                                          z_distribution(generator)));
+  }
+
+  double getBaseRisk(const Cell& cell) const {
+    auto it = base_risk.find(cell);
+    return it == base_risk.end() ? kLowRisk : it->second;
+  }
+
+  // Like the risk of the planner, the risk of a cell also reads its neighbors
+  HeuristicField::RiskFunction cellRisk() {
+    return [this](const Cell& cell) {
+      num_risk_evaluations++;
+      double neighbor_risk = 0.0;
+      for (const Cell& offset : {Cell(std::tuple<int, int, int>(1, 0, 0)), Cell(std::tuple<int, int, int>(-1, 0, 0)),
+                                 Cell(std::tuple<int, int, int>(0, 1, 0)), Cell(std::tuple<int, int, int>(0, -1, 0)),
+                                 Cell(std::tuple<int, int, int>(0, 0, 1)), Cell(std::tuple<int, int, int>(0, 0, -1))}) {
+        neighbor_risk = std::max(neighbor_risk, getBaseRisk(cell + offset));
+      }
+      return getBaseRisk(cell) + 0.1 * neighbor_risk;
+    };
+  }
+
+  // Changes the risk of random cells, changed_cells gets the cells
+  void changeMap(int num_cells, std::unordered_set<Cell>& changed_cells) {
+    std::uniform_int_distribution<int> risk_distribution(0, 2);
+    const double risks[] = {kLowRisk, 0.05, 1.0};
+    for (int i = 0; i < num_cells; ++i) {
+      Cell cell = randomCell();
+      base_risk[cell] = risks[risk_distribution(generator)];
+      changed_cells.insert(cell);
+    }
+  }
+
+  std::vector<Cell> boxCells() const {
+    std::vector<Cell> cells;
+    for (int x = -params.margin; x <= goal.xIndex() + params.margin; ++x) {
+      for (int y = -params.margin; y <= goal.yIndex() + params.margin; ++y) {
+        for (int z = params.min_altitude; z <= params.max_altitude; ++z) {
+          cells.push_back(Cell(std::tuple<int, int, int>(x, y, z)));
+        }
+      }
+    }
+    return cells;
+  }
+
+  void expectSameField(const HeuristicField& expected, const HeuristicField& actual) {
+    for (const Cell& cell : boxCells()) {
+      double expected_cost = expected.getCostToGoal(cell);
+      double actual_cost = actual.getCostToGoal(cell);
+      if (std::isinf(expected_cost)) {
+        ASSERT_TRUE(std::isinf(actual_cost)) << cell.asString();
+      } else {
+        ASSERT_NEAR(expected_cost, actual_cost, 1e-3 * expected_cost) << cell.asString();
+      }
+    }
+  }
+
+  // Dijkstra backwards from the goal over the unit steps of the box, where
+  // entering a cell costs its risk like in the cost of the planner
+  std::unordered_map<Cell, double> trueCostToGoal() {
+    HeuristicField::RiskFunction cell_risk = cellRisk();
+    std::vector<Cell> cells = boxCells();
+    std::unordered_set<Cell> in_box(cells.begin(), cells.end());
+    std::unordered_map<Cell, double> distance;
+    typedef std::pair<double, Cell> DistanceCell;
+    auto compare = [](const DistanceCell& a, const DistanceCell& b) { return a.first > b.first; };
+    std::priority_queue<DistanceCell, std::vector<DistanceCell>, decltype(compare)> pq(compare);
+    for (const Cell& cell : cells) {
+      if (goal.withinPlanRadius(cell)) {
+        distance[cell] = 0.0;
+        pq.push(std::make_pair(0.0, cell));
+      }
+    }
+    while (!pq.empty()) {
+      DistanceCell u = pq.top();
+      pq.pop();
+      if (u.first > distance[u.second]) {
+        continue;
+      }
+      double risk = cell_risk(u.second);
+      if (risk >= params.max_cell_risk) {
+        continue;  // u can't be entered
+      }
+      for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dz = -1; dz <= 1; ++dz) {
+            if ((dx == 0 && dy == 0) == (dz == 0)) {
+              continue;  // Horizontal or vertical unit steps
+            }
+            Cell v = u.second + Cell(std::tuple<int, int, int>(dx, dy, dz));
+            if (in_box.find(v) == in_box.end()) {
+              continue;
+            }
+            double step_cost = dz == 0 ? std::sqrt(dx * dx + dy * dy) * (1.0 + params.risk_factor * risk)
+                                       : (dz < 0 ? params.up_cost : params.down_cost) + params.risk_factor * risk;
+            double new_dist = u.first + step_cost;
+            auto v_dist = distance.find(v);
+            if (v_dist == distance.end() || new_dist < v_dist->second) {
+              distance[v] = new_dist;
+              pq.push(std::make_pair(new_dist, v));
+            }
+          }
+        }
+      }
+    }
+    return distance;
+  }
+};
+
+TEST_F(HeuristicFieldTests, repairMatchesRecompute) {
+  // GIVEN: a field
+  HeuristicField field;
+  field.compute(goal, start, params, cellRisk());
+  ASSERT_TRUE(field.isValid());
+
+  for (int i = 0; i < 10; ++i) {
+    // WHEN: the risk of some cells changes and the field is repaired
+    std::unordered_set<Cell> changed_cells;
+    changeMap(15, changed_cells);
+    num_risk_evaluations = 0;
+    field.refresh(cellRisk(), changed_cells, 1);
+
+    // THEN: only the cells around the changes are evaluated again
+    EXPECT_LT(num_risk_evaluations, field.size() / 2);
+
+    // AND: the field is the same as a field computed for the changed map
+    HeuristicField recomputed;
+    recomputed.compute(goal, start, params, cellRisk());
+    expectSameField(recomputed, field);
+  }
+}
+
+TEST_F(HeuristicFieldTests, flatCoarseRepairMatchesRecompute) {
+  // GIVEN: a field that collapses the altitudes and has 2x2 cells per field cell
+  params.is_3D = false;
+  params.scale = 2;
+  HeuristicField field;
+  field.compute(goal, start, params, cellRisk());
+
+  for (int i = 0; i < 10; ++i) {
+    // WHEN: the risk of some cells changes and the field is repaired
+    std::unordered_set<Cell> changed_cells;
+    changeMap(10, changed_cells);
+    field.refresh(cellRisk(), changed_cells, 1);
+
+    // THEN: the field is the same as a field computed for the changed map
+    HeuristicField recomputed;
+    recomputed.compute(goal, start, params, cellRisk());
+    expectSameField(recomputed, field);
+  }
+}
+
+TEST_F(HeuristicFieldTests, repairedFieldIsLowerBound) {
+  // GIVEN: a field
+  HeuristicField field;
+  field.compute(goal, start, params, cellRisk());
+
+  for (int i = 0; i < 5; ++i) {
+    // WHEN: the map changes and the field is repaired
+    std::unordered_set<Cell> changed_cells;
+    changeMap(20, changed_cells);
+    field.refresh(cellRisk(), changed_cells, 1);
+
+    // THEN: the field never exceeds the cost to the goal
+    std::unordered_map<Cell, double> true_cost = trueCostToGoal();
+    ASSERT_FALSE(true_cost.empty());
+    for (const auto& cell_cost : true_cost) {
+      EXPECT_LE(field.getCostToGoal(cell_cost.first), cell_cost.second * (1.0 + 1e-5) + 1e-5)
+          << cell_cost.first.asString();
+    }
+  }
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+
+#include "global_planner/global_planner.h"
+#include "global_planner/site_cache.h"
+
+using namespace global_planner;
+
+class SiteCacheTests : public ::testing::Test {
+ public:
+  GlobalPlanner planner;
+  GlobalPlanner loaded;
+  std::string filename;
+
+  // Use this method to set up any state that you need for all of your tests
+  void SetUp() override {
+    // GIVEN: a planner with a map and some cached risks
+    octomap::OcTree* tree = new octomap::OcTree(1.0);
+    for (int x = -2; x < 8; ++x) {
+      for (int y = -2; y < 8; ++y) {
+        for (int z = 1; z < 6; ++z) {
+          tree->setNodeValue(x + 0.5, y + 0.5, z + 0.5, -2.0f, true);
+        }
+      }
+    }
+    tree->setNodeValue(3.5, 3.5, 2.5, 3.5f, true);
+    planner.setRobotRadius(0.5);
+    planner.updateFullOctomap(tree);
+    for (int x = 0; x < 6; ++x) {
+      planner.getRisk(makeCell(x, 3, 2));
+    }
+    loaded.setRobotRadius(0.5);
+
+    std::ostringstream name;
+    name << "/tmp/test_site_cache_" << getpid() << ".bin";
+    filename = name.str();
+  }
+
+  void TearDown() override {
+    std::remove(filename.c_str());
+    delete planner.octree_;
+    delete loaded.octree_;
+  }
+
+  static Cell makeCell(int x, int y, int z) { return Cell(std::tuple<int, int, int>(x, y, z)); }
+
+  std::string readFile() const {
+    std::ifstream in(filename, std::ios::binary);
+    std::ostringstream data;
+    data << in.rdbuf();
+    return data.str();
+  }
+
+  void writeFile(const std::string& data) const {
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out << data;
+  }
+};
+
+TEST_F(SiteCacheTests, roundTrip) {
+  // WHEN: we save the site cache and load it into another planner
+  ASSERT_TRUE(planner.saveSiteCache(filename));
+  ASSERT_TRUE(loaded.loadSiteCache(filename));
+
+  // THEN: the other planner has the same map and cached risks
+  ASSERT_TRUE(loaded.octree_ != NULL);
+  EXPECT_TRUE(planner.getSiteCacheKey() == loaded.getSiteCacheKey());
+  EXPECT_TRUE(loaded.isOccupied(makeCell(3, 3, 2)));
+  EXPECT_FALSE(loaded.isOccupied(makeCell(1, 3, 2)));
+  ASSERT_EQ(planner.risk_cache_.size(), loaded.risk_cache_.size());
+  for (const auto& cell_risk : planner.risk_cache_) {
+    auto it = loaded.risk_cache_.find(cell_risk.first);
+    ASSERT_TRUE(it != loaded.risk_cache_.end()) << cell_risk.first.asString();
+    EXPECT_EQ(cell_risk.second, it->second);
+  }
+}
+
+TEST_F(SiteCacheTests, reopenedFileIsRead) {
+  // GIVEN: two site caches with different numbers of risks
+  std::string other_filename = filename + ".other";
+  ASSERT_TRUE(planner.saveSiteCache(other_filename));
+  planner.getRisk(makeCell(0, 0, 3));
+  ASSERT_TRUE(planner.saveSiteCache(filename));
+
+  // WHEN: one file object opens both
+  SiteCacheFile file;
+  ASSERT_TRUE(file.open(other_filename));
+  size_t other_num_risks = file.numRisks();
+  ASSERT_TRUE(file.open(filename));
+  std::remove(other_filename.c_str());
+
+  // THEN: it reads the second one
+  EXPECT_EQ(other_num_risks + 1, file.numRisks());
+  EXPECT_EQ(planner.risk_cache_.size(), file.numRisks());
+}
+
+TEST_F(SiteCacheTests, keyMismatchDropsRisks) {
+  // GIVEN: a planner for a larger robot
+  ASSERT_TRUE(planner.saveSiteCache(filename));
+  loaded.setRobotRadius(1.0);
+
+  // WHEN: it loads the site cache
+  ASSERT_TRUE(loaded.loadSiteCache(filename));
+
+  // THEN: it uses the map, but not the risks of the smaller robot
+  ASSERT_TRUE(loaded.octree_ != NULL);
+  EXPECT_TRUE(loaded.isOccupied(makeCell(3, 3, 2)));
+  EXPECT_TRUE(loaded.risk_cache_.empty());
+}
+
+TEST_F(SiteCacheTests, resolutionMismatchDropsRisks) {
+  // GIVEN: a site cache whose risks were computed for a finer map than the one in the file
+  std::ostringstream octree_data;
+  planner.octree_->write(octree_data);
+  SiteCacheKey key = planner.getSiteCacheKey();
+  key.octree_resolution = 0.5;
+  std::vector<RiskRecord> risks = {RiskRecord{0.5, 1, 3, 2, 0}};
+  ASSERT_TRUE(writeSiteCacheFile(filename, key, octree_data.str(), risks, ""));
+
+  // WHEN: we load it
+  ASSERT_TRUE(loaded.loadSiteCache(filename));
+
+  // THEN: the risks are not used
+  EXPECT_TRUE(loaded.risk_cache_.empty());
+}
+
+TEST_F(SiteCacheTests, truncatedFileIsRejected) {
+  // GIVEN: a site cache that lost its end
+  ASSERT_TRUE(planner.saveSiteCache(filename));
+  std::string data = readFile();
+  writeFile(data.substr(0, data.size() - 9));
+
+  // WHEN: we load it
+  bool is_loaded = loaded.loadSiteCache(filename);
+
+  // THEN: nothing is loaded
+  EXPECT_FALSE(is_loaded);
+  EXPECT_TRUE(loaded.octree_ == NULL);
+  EXPECT_TRUE(loaded.risk_cache_.empty());
+}
+
+TEST_F(SiteCacheTests, overflowingSectionIsRejected) {
+  // GIVEN: a site cache whose octree section starts so far that its end wraps around
+  ASSERT_TRUE(planner.saveSiteCache(filename));
+  std::string data = readFile();
+  size_t octree_offset_position = 8 + sizeof(SiteCacheKey);  // After the magic and the key
+  uint64_t octree_offset = ~uint64_t(0) - 3;
+  std::memcpy(&data[octree_offset_position], &octree_offset, sizeof(octree_offset));
+  writeFile(data);
+
+  // THEN: the file can't be opened
+  SiteCacheFile file;
+  EXPECT_FALSE(file.open(filename));
+  EXPECT_FALSE(loaded.loadSiteCache(filename));
+}
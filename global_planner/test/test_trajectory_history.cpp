@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <tuple>
+#include <vector>
+
+#include "global_planner/trajectory_history.h"
+
+using namespace global_planner;
+
+class TrajectoryHistoryTests : public ::testing::Test {
+ public:
+  TrajectoryHistory history;
+  std::vector<Cell> cells;
+
+  // Use this method to set up any state that you need for all of your tests
+  void SetUp() override {
+    // GIVEN: a flight of 5 cells along x, a turn, and 4 cells along y
+    for (int i = 0; i < 5; ++i) {
+      cells.push_back(makeCell(i, 0, 2));
+    }
+    for (int i = 1; i <= 4; ++i) {
+      cells.push_back(makeCell(4, i, 2));
+    }
+  }
+
+  static Cell makeCell(int x, int y, int z) { return Cell(std::tuple<int, int, int>(x, y, z)); }
+
+  void pushCells() {
+    for (const Cell& cell : cells) {
+      history.push_back(cell);
+    }
+  }
+
+  // The cells of the history, newest first
+  std::vector<Cell> reversed() const {
+    std::vector<Cell> result;
+    for (auto it = history.rbegin(); it != history.rend(); ++it) {
+      result.push_back(*it);
+    }
+    return result;
+  }
+
+  void expectNewest(int num_cells) {
+    std::vector<Cell> result = reversed();
+    ASSERT_EQ(num_cells, static_cast<int>(result.size()));
+    for (int i = 0; i < num_cells; ++i) {
+      EXPECT_TRUE(result[i] == cells[cells.size() - 1 - i]) << "cell " << i;
+    }
+  }
+};
+
+TEST_F(TrajectoryHistoryTests, straightStretchesAreMerged) {
+  // WHEN: we add the cells
+  pushCells();
+
+  // THEN: each straight stretch is one run and all cells are kept
+  EXPECT_EQ(2, history.numRuns());
+  EXPECT_EQ(9, history.size());
+  EXPECT_TRUE(history.back() == cells.back());
+}
+
+TEST_F(TrajectoryHistoryTests, reverseIterationVisitsNewestFirst) {
+  // WHEN: we add the cells
+  pushCells();
+
+  // THEN: the iteration goes back along both runs
+  expectNewest(9);
+}
+
+TEST_F(TrajectoryHistoryTests, oldestCellsAreDroppedAtTheLimit) {
+  // GIVEN: a history shorter than the flight
+  history.setMaxSize(3);
+
+  // WHEN: we add the cells
+  pushCells();
+
+  // THEN: only the newest cells are left, in the second run
+  EXPECT_EQ(3, history.size());
+  EXPECT_EQ(1, history.numRuns());
+  expectNewest(3);
+}
+
+TEST_F(TrajectoryHistoryTests, shrinkingDropsTheOldestCells) {
+  // GIVEN: a history with all cells
+  pushCells();
+
+  // WHEN: the limit is lowered into the second run
+  history.setMaxSize(6);
+
+  // THEN: the first run is cut and the newest cells are left
+  EXPECT_EQ(6, history.size());
+  EXPECT_EQ(2, history.numRuns());
+  expectNewest(6);
+}
+
+TEST_F(TrajectoryHistoryTests, popBackAcrossRuns) {
+  // GIVEN: a history with all cells
+  pushCells();
+
+  // WHEN: we remove more cells than the newest run has
+  history.popBack(6);
+
+  // THEN: the second run is gone and the first is shortened
+  EXPECT_EQ(3, history.size());
+  EXPECT_EQ(1, history.numRuns());
+  EXPECT_TRUE(history.back() == makeCell(2, 0, 2));
+
+  // AND: new cells continue from the shortened run
+  history.push_back(makeCell(2, 1, 2));
+  EXPECT_EQ(4, history.size());
+  EXPECT_EQ(2, history.numRuns());
+  EXPECT_TRUE(*history.rbegin() == makeCell(2, 1, 2));
+}
+
+TEST_F(TrajectoryHistoryTests, popBackEverything) {
+  // GIVEN: a history with all cells
+  pushCells();
+
+  // WHEN: we remove more cells than there are
+  history.popBack(20);
+
+  // THEN: the history is empty
+  EXPECT_TRUE(history.empty());
+  EXPECT_EQ(0, history.numRuns());
+  EXPECT_FALSE(history.rbegin() != history.rend());
+}
@@ -3,45 +3,88 @@
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <utility>
+#include <vector>
+
 namespace avoidance {
 
+// The mean and variance matrices of the grid are views into one float buffer,
+// the counter and land matrices into one int buffer, one matrix after the
+// other. The views are reseated whenever the buffers change, so copies and
+// moves of a Grid point to their own data
 class Grid {
  public:
-  Grid(const float grid_size, const float cell_size) : grid_size_(grid_size), cell_size_(cell_size) {
-    resize(grid_size_, cell_size_);
-  }
+  typedef Eigen::Map<Eigen::MatrixXf> FloatView;
+  typedef Eigen::Map<Eigen::MatrixXi> IntView;
+  typedef Eigen::Map<const Eigen::MatrixXf> ConstFloatView;
+  typedef Eigen::Map<const Eigen::MatrixXi> ConstIntView;
+
+  Grid(const float grid_size, const float cell_size) : Grid() { resize(grid_size, cell_size); }
+  Grid(const Grid &other) : Grid() { *this = other; }
+  Grid(Grid &&other) noexcept : Grid() { swap(other); }
   ~Grid() = default;
 
+  Grid &operator=(const Grid &other) {
+    if (this != &other) {
+      float_data_ = other.float_data_;
+      int_data_ = other.int_data_;
+      corner_min_ = other.corner_min_;
+      corner_max_ = other.corner_max_;
+      grid_size_ = other.grid_size_;
+      cell_size_ = other.cell_size_;
+      grid_row_col_size_ = other.grid_row_col_size_;
+      setViews();
+    }
+    return *this;
+  }
+
+  Grid &operator=(Grid &&other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  void swap(Grid &other) noexcept {
+    float_data_.swap(other.float_data_);
+    int_data_.swap(other.int_data_);
+    std::swap(corner_min_, other.corner_min_);
+    std::swap(corner_max_, other.corner_max_);
+    std::swap(grid_size_, other.grid_size_);
+    std::swap(cell_size_, other.cell_size_);
+    std::swap(grid_row_col_size_, other.grid_row_col_size_);
+    setViews();
+    other.setViews();
+  }
+
   void reset() {
-    mean_.fill(0.f);
-    variance_.fill(0.f);
-    counter_.fill(0);
-    land_.fill(0);
+    std::fill(float_data_.begin(), float_data_.end(), 0.f);
+    std::fill(int_data_.begin(), int_data_.end(), 0);
   }
 
   void resize(float grid_size, float cell_size) {
     grid_size_ = grid_size;
     cell_size_ = cell_size;
     grid_row_col_size_ = static_cast<int>(std::ceil(grid_size_ / cell_size_));
-    mean_.resize(grid_row_col_size_, grid_row_col_size_);
-    variance_.resize(grid_row_col_size_, grid_row_col_size_);
-    counter_.resize(grid_row_col_size_, grid_row_col_size_);
-    land_.resize(grid_row_col_size_, grid_row_col_size_);
-    reset();
+    size_t n_cells = grid_row_col_size_ * grid_row_col_size_;
+    float_data_.assign(2 * n_cells, 0.f);
+    int_data_.assign(2 * n_cells, 0);
+    setViews();
   }
 
   void setMean(const Eigen::Vector2i &idx, float value) { mean_(idx.x(), idx.y()) = value; }
   void setVariance(const Eigen::Vector2i &idx, float value) { variance_(idx.x(), idx.y()) = value; }
-  void increaseCounter(const Eigen::Vector2i &idx) { counter_(idx.x(), idx.y()) = counter_(idx.x(), idx.y()) + 1; }
+  void increaseCounter(const Eigen::Vector2i &idx) { counter_(idx.x(), idx.y()) += 1; }
   void setCounter(const Eigen::Vector2i &idx, int value) { counter_(idx.x(), idx.y()) = value; }
 
-  Eigen::MatrixXf getMean() const { return mean_; }
-  Eigen::MatrixXf getVariance() const { return variance_; }
-  Eigen::MatrixXi getCounter() const { return counter_; }
+  ConstFloatView getMean() const { return ConstFloatView(mean_.data(), mean_.rows(), mean_.cols()); }
+  ConstFloatView getVariance() const { return ConstFloatView(variance_.data(), variance_.rows(), variance_.cols()); }
+  ConstIntView getCounter() const { return ConstIntView(counter_.data(), counter_.rows(), counter_.cols()); }
 
-  float getMean(const Eigen::Vector2i &idx) { return mean_(idx.x(), idx.y()); }
-  float getVariance(const Eigen::Vector2i &idx) { return variance_(idx.x(), idx.y()); }
-  int getCounter(const Eigen::Vector2i &idx) { return counter_(idx.x(), idx.y()); }
+  float getMean(const Eigen::Vector2i &idx) const { return mean_(idx.x(), idx.y()); }
+  float getVariance(const Eigen::Vector2i &idx) const { return variance_(idx.x(), idx.y()); }
+  int getCounter(const Eigen::Vector2i &idx) const { return counter_(idx.x(), idx.y()); }
   int getRowColSize() const { return grid_row_col_size_; }
   float getGridSize() const { return grid_size_; }
   float getCellSize() const { return cell_size_; }
@@ -53,6 +96,22 @@ class Grid {
     corner_max_.y() = pos.y() + grid_size_ / 2.f;
   }
 
+  /**
+  * @brief places the grid around pos with its lower limits on multiples of
+  * the cell size, so the cells stay on the same patches of ground as the
+  * vehicle moves
+  **/
+  void setAnchoredFilterLimits(const Eigen::Vector3f &pos) {
+    corner_min_.x() = std::floor((pos.x() - grid_size_ / 2.f) / cell_size_) * cell_size_;
+    corner_min_.y() = std::floor((pos.y() - grid_size_ / 2.f) / cell_size_) * cell_size_;
+    corner_max_ = corner_min_ + Eigen::Vector2f::Constant(getExtent());
+  }
+
+  void setGridLimits(const Eigen::Vector2f &min) {
+    corner_min_ = min;
+    corner_max_ = min + Eigen::Vector2f::Constant(getExtent());
+  }
+
   void getGridLimits(Eigen::Vector2f &min, Eigen::Vector2f &max) const {
     min = corner_min_;
     max = corner_max_;
@@ -63,14 +122,40 @@ class Grid {
     variance_ = alpha * prev_grid.variance_ + (1.f - alpha) * variance_;
   }
 
-  Eigen::MatrixXi land_;
-  Eigen::MatrixXf mean_;
+  IntView land_;
+  FloatView mean_;
 
  private:
+  Grid()
+      : land_(nullptr, 0, 0),
+        mean_(nullptr, 0, 0),
+        corner_min_(Eigen::Vector2f::Zero()),
+        corner_max_(Eigen::Vector2f::Zero()),
+        variance_(nullptr, 0, 0),
+        counter_(nullptr, 0, 0),
+        grid_size_(0.f),
+        cell_size_(0.f),
+        grid_row_col_size_(0) {}
+
+  // side length of the cells, the grid size rounded up to whole cells
+  float getExtent() const { return grid_row_col_size_ * cell_size_; }
+
+  // points the matrices to their part of the buffers
+  void setViews() {
+    int n = grid_row_col_size_;
+    size_t n_cells = n * n;
+    new (&mean_) FloatView(float_data_.data(), n, n);
+    new (&variance_) FloatView(float_data_.data() + n_cells, n, n);
+    new (&counter_) IntView(int_data_.data(), n, n);
+    new (&land_) IntView(int_data_.data() + n_cells, n, n);
+  }
+
+  std::vector<float> float_data_;
+  std::vector<int> int_data_;
   Eigen::Vector2f corner_min_;
   Eigen::Vector2f corner_max_;
-  Eigen::MatrixXf variance_;
-  Eigen::MatrixXi counter_;
+  FloatView variance_;
+  IntView counter_;
 
   float grid_size_;
   float cell_size_;
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "grid.hpp"
+
+namespace avoidance {
+
+/**
+* @brief height statistics of the patches of ground under the grid, kept
+* across frames. The cell with world indexes (x, y) is stored at
+* (x mod size, y mod size), so when the grid moves by whole cells only the
+* rows and columns that enter it are cleared
+**/
+class RollingGrid {
+ public:
+  RollingGrid() = default;
+  ~RollingGrid() = default;
+
+  void resize(int size) {
+    size_ = size;
+    cells_.assign(size_ * size_, CellHistory());
+    initialized_ = false;
+  }
+
+  /**
+  * @brief moves the window to the limits of grid, forgets the statistics of
+  * the previous frames by alpha, adds the statistics of the current frame and
+  * writes the result back to grid
+  * @param[in, out] grid, statistics of the points of the current frame, its
+  * lower limits must be multiples of the cell size
+  * @param[in] alpha, weight of the previous frames
+  **/
+  void update(Grid &grid, float alpha) {
+    if (grid.getRowColSize() != size_) {
+      resize(grid.getRowColSize());
+    }
+    Eigen::Vector2f grid_min, grid_max;
+    grid.getGridLimits(grid_min, grid_max);
+    Eigen::Vector2i corner(static_cast<int>(std::round(grid_min.x() / grid.getCellSize())),
+                           static_cast<int>(std::round(grid_min.y() / grid.getCellSize())));
+    scroll(corner);
+
+    for (int i = 0; i < size_; i++) {
+      for (int j = 0; j < size_; j++) {
+        Eigen::Vector2i idx(i, j);
+        CellHistory &cell = cells_[wrap(corner_.x() + i) * size_ + wrap(corner_.y() + j)];
+        cell.weight *= alpha;
+        cell.M2 *= alpha;
+        cell.frames = alpha * cell.frames + 1.0;
+
+        // add the points of this frame with the parallel variance formula
+        int count = grid.getCounter(idx);
+        if (count > 0) {
+          double weight = cell.weight + count;
+          double delta = grid.getMean(idx) - cell.mean;
+          cell.M2 += grid.getVariance(idx) * count + delta * delta * cell.weight * count / weight;
+          cell.mean += delta * count / weight;
+          cell.weight = weight;
+        }
+
+        // the counter is the weighted average number of points per frame
+        if (cell.weight > 0.0) {
+          grid.setMean(idx, static_cast<float>(cell.mean));
+          grid.setVariance(idx, static_cast<float>(cell.M2 / cell.weight));
+          grid.setCounter(idx, static_cast<int>(std::round(cell.weight / cell.frames)));
+        }
+      }
+    }
+  }
+
+ private:
+  struct CellHistory {
+    double weight = 0.0;  // number of points, each forgotten by alpha per frame
+    double mean = 0.0;
+    double M2 = 0.0;      // weighted sum of squared differences from the mean
+    double frames = 0.0;  // number of frames since the cell entered the grid, weighted like the points
+  };
+
+  std::vector<CellHistory> cells_;
+  Eigen::Vector2i corner_ = Eigen::Vector2i::Zero();  // world indexes of the lower grid corner
+  int size_ = 0;
+  bool initialized_ = false;
+
+  int wrap(int index) const { return ((index % size_) + size_) % size_; }
+
+  void clearRow(int x) {
+    std::fill(cells_.begin() + wrap(x) * size_, cells_.begin() + (wrap(x) + 1) * size_, CellHistory());
+  }
+
+  void clearColumn(int y) {
+    for (int r = 0; r < size_; r++) {
+      cells_[r * size_ + wrap(y)] = CellHistory();
+    }
+  }
+
+  void scroll(const Eigen::Vector2i &corner) {
+    if (!initialized_ || std::abs(corner.x() - corner_.x()) >= size_ || std::abs(corner.y() - corner_.y()) >= size_) {
+      std::fill(cells_.begin(), cells_.end(), CellHistory());
+    } else {
+      // the world rows and columns that were outside the old window
+      for (int x = corner_.x() + size_; x < corner.x() + size_; x++) clearRow(x);
+      for (int x = corner.x(); x < corner_.x(); x++) clearRow(x);
+      for (int y = corner_.y() + size_; y < corner.y() + size_; y++) clearColumn(y);
+      for (int y = corner.y(); y < corner_.y(); y++) clearColumn(y);
+    }
+    corner_ = corner;
+    initialized_ = true;
+  }
+};
+}
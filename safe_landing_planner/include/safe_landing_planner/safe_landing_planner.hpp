@@ -5,14 +5,29 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <vector>
+
 #include <dynamic_reconfigure/server.h>
 #include <safe_landing_planner/SLPGridMsg.h>
 #include <safe_landing_planner/SafeLandingPlannerNodeConfig.h>
 
 #include "grid.hpp"
+#include "rolling_grid.hpp"
 
 namespace avoidance {
 
+/**
+* @brief height statistics of the grid cells for one chunk of the pointcloud,
+* the heights are relative to the vehicle
+**/
+struct CellStatistics {
+  std::vector<int> count;
+  std::vector<double> sum;
+  std::vector<double> sum_squares;
+
+  void resize(int n_cells);
+};
+
 class SafeLandingPlanner {
  public:
   SafeLandingPlanner() = default;
@@ -49,13 +64,15 @@ class SafeLandingPlanner {
   void isLandingPossible();
 
   Eigen::Vector2i getPositionIndex() const { return pos_index_; };
-  Grid getPreviousGrid() const { return previous_grid_; };
-  Grid getGrid() const { return grid_; };
+  const Grid& getPreviousGrid() const { return previous_grid_; };
+  const Grid& getGrid() const { return grid_; };
   int getSmoothingSize() const { return smoothing_size_; };
 
   safe_landing_planner::SLPGridMsg raw_grid_;
 
   bool play_rosbag_ = false;
+  bool fill_visualization_cloud_ = true;  // set to false when nobody subscribes to the binned cloud
+  int n_threads_ = 0;                     // threads binning the pointcloud, 0 means one per core
 
  protected:
   Eigen::Vector3f position_ = Eigen::Vector3f::Zero();
@@ -73,9 +90,11 @@ class SafeLandingPlanner {
   int smoothing_size_ = 1;
   int min_n_land_cells_ = 9;
   bool size_update_ = false;
+  bool use_rolling_grid_ = false;
 
   Grid grid_ = Grid(10.f, 1.f);
   Grid previous_grid_ = Grid(10.f, 1.f);
+  RollingGrid rolling_grid_;
 
   /**
   * @brief process the pointcloud and calculate mean and variance for points in
@@ -83,30 +102,32 @@ class SafeLandingPlanner {
   **/
   void processPointcloud();
 
+  /**
+  * @brief adds the heights of the pointcloud points begin to end - 1 to the
+  *statistics of their cells
+  * @param[in] begin, index of the first point
+  * @param[in] end, index after the last point
+  * @param[out] statistics, cell statistics of this chunk of points
+  * @param[out] visualization_points, binned points if fill_visualization_cloud_ is set
+  **/
+  void binPoints(int begin, int end, CellStatistics& statistics,
+                 std::vector<pcl::PointXYZI>& visualization_points) const;
+
   /**
   * @brief checks if a point cloud point is inside the 2D grid
   * @param[in] x, x coordinate of the pointcloud point
   * @param[in] y, y coordinate of the pointcloud point
   * @return true, if point is inside the grid
   **/
-  bool isInsideGrid(float x, float y);
+  bool isInsideGrid(float x, float y) const;
   /**
   * @brief computes the grid bin to which a point is mapped to
   * @param[in] x, x coordinate of the pointcloud point
   * @param[in] y, y coordinate of the pointcloud point
   * @returns indexes of the 2D grid
   **/
-  Eigen::Vector2i computeGridIndexes(float x, float y);
+  Eigen::Vector2i computeGridIndexes(float x, float y) const;
 
-  /**
-  * @brief computes the online mean and variance of a grid bin on the z value
-  * @param[in] prev_mean, previous bin mean value
-  * @param[in] prev_variance, previous bin varinace value
-  * @param[in] new_value, new data point to be averaged
-  * @param[in] seq, number of data points already in the bin
-  * @returns bin mean and variance
-  **/
-  std::pair<float, float> computeOnlineMeanVariance(float prev_mean, float prev_variance, float new_value, float seq);
   /**
   * @brief process the grid coming from a rosbag and map it to the datatypes
   * such that the algorithm can be run again
@@ -6,6 +6,7 @@
 #endif
 
 #include <avoidance/common.h>
+#include <boost/make_shared.hpp>
 #include <dynamic_reconfigure/server.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <mavros_msgs/CompanionProcessStatus.h>
@@ -28,6 +28,12 @@ class SafeLandingPlannerVisualization {
                                    const geometry_msgs::Point& last_pos,
                                    safe_landing_planner::SafeLandingPlannerNodeConfig& config);
 
+  /**
+  * @brief      checks if someone subscribes to the pointcloud of the binned
+  *points, the planner only fills it then
+  **/
+  bool isPointcloudSubscribed() const { return local_pointcloud_pub_.getNumSubscribers() > 0; }
+
  private:
   ros::Publisher local_pointcloud_pub_;
   ros::Publisher grid_pub_;
@@ -1,12 +1,27 @@
 #include "safe_landing_planner/safe_landing_planner.hpp"
 #include "avoidance/common.h"
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 namespace avoidance {
 
+namespace {
+const int kMinPointsPerChunk = 20000;  // smaller clouds are not worth a thread
+}
+
+void CellStatistics::resize(int n_cells) {
+  count.assign(n_cells, 0);
+  sum.assign(n_cells, 0.0);
+  sum_squares.assign(n_cells, 0.0);
+}
+
 void SafeLandingPlanner::runSafeLandingPlanner() {
   if (size_update_) {
     grid_.resize(grid_size_, cell_size_);
     previous_grid_.resize(grid_size_, cell_size_);
+    rolling_grid_.resize(grid_.getRowColSize());
     n_lines_padding_ = smoothing_size_;
     size_update_ = false;
   }
@@ -16,36 +31,118 @@ void SafeLandingPlanner::runSafeLandingPlanner() {
     processRawGrid();
   }
 
-  // low pass filter on grid mean and variance
-  grid_.combine(previous_grid_, alpha_);
+  if (use_rolling_grid_ && !play_rosbag_) {
+    // exponential forgetting of the statistics of each patch of ground
+    rolling_grid_.update(grid_, alpha_);
+  } else {
+    // low pass filter on grid mean and variance
+    grid_.combine(previous_grid_, alpha_);
+  }
   isLandingPossible();
 }
 
 void SafeLandingPlanner::processPointcloud() {
   std::swap(previous_grid_, grid_);
-  grid_.setFilterLimits(position_);
+  if (use_rolling_grid_) {
+    grid_.setAnchoredFilterLimits(position_);
+  } else {
+    grid_.setFilterLimits(position_);
+  }
   grid_seq_ += 1;
   grid_.reset();
   visualization_cloud_.header = cloud_.header;
   visualization_cloud_.points.clear();
   ROS_INFO("Input cloud size %lu ", cloud_.points.size());
-  for (const pcl::PointXYZ& xyz : cloud_) {
+
+  // each chunk of the cloud is binned by its own thread into its own statistics
+  int n_points = cloud_.points.size();
+  int n_threads = n_threads_ > 0 ? n_threads_ : std::max(1u, std::thread::hardware_concurrency());
+  int n_chunks = std::min(n_threads, n_points / kMinPointsPerChunk + 1);
+  int n_cells = grid_.getRowColSize() * grid_.getRowColSize();
+  std::vector<CellStatistics> chunk_statistics(n_chunks);
+  std::vector<std::vector<pcl::PointXYZI>> chunk_visualization_points(n_chunks);
+  auto bin_chunk = [&](int chunk) {
+    chunk_statistics[chunk].resize(n_cells);
+    binPoints(chunk * n_points / n_chunks, (chunk + 1) * n_points / n_chunks, chunk_statistics[chunk],
+              chunk_visualization_points[chunk]);
+  };
+  std::vector<std::thread> threads;
+  for (int chunk = 1; chunk < n_chunks; chunk++) {
+    threads.emplace_back(bin_chunk, chunk);
+  }
+  bin_chunk(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // merge the chunks with the parallel variance formula of Chan et al.
+  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+  for (int i = 0; i < grid_.getRowColSize(); i++) {
+    for (int j = 0; j < grid_.getRowColSize(); j++) {
+      int cell = i * grid_.getRowColSize() + j;
+      int count = 0;
+      double sum = 0.0;
+      double M2 = 0.0;
+      for (const CellStatistics& statistics : chunk_statistics) {
+        int chunk_count = statistics.count[cell];
+        if (chunk_count == 0) {
+          continue;
+        }
+        double chunk_sum = statistics.sum[cell];
+        double chunk_M2 = std::max(0.0, statistics.sum_squares[cell] - chunk_sum * chunk_sum / chunk_count);
+        if (count > 0) {
+          double delta = chunk_sum / chunk_count - sum / count;
+          M2 += delta * delta * count * chunk_count / (count + chunk_count);
+        }
+        count += chunk_count;
+        sum += chunk_sum;
+        M2 += chunk_M2;
+      }
+      if (count > 0) {
+        Eigen::Vector2i grid_index(i, j);
+        grid_.setCounter(grid_index, count);
+        grid_.setMean(grid_index, static_cast<float>(position_.z() + sum / count));
+        grid_.setVariance(grid_index, static_cast<float>(M2 / count));
+      }
+    }
+  }
+
+  // cloud for visualization of the binning
+  if (fill_visualization_cloud_) {
+    visualization_cloud_.points.reserve(n_points);
+    for (const std::vector<pcl::PointXYZI>& points : chunk_visualization_points) {
+      visualization_cloud_.points.insert(visualization_cloud_.points.end(), points.begin(), points.end());
+    }
+  }
+}
+
+void SafeLandingPlanner::binPoints(int begin, int end, CellStatistics& statistics,
+                                   std::vector<pcl::PointXYZI>& visualization_points) const {
+  int size = grid_.getRowColSize();
+  if (fill_visualization_cloud_) {
+    visualization_points.reserve(end - begin);
+  }
+  for (int p = begin; p < end; p++) {
+    const pcl::PointXYZ& xyz = cloud_.points[p];
     if (!std::isnan(xyz.x) && !std::isnan(xyz.y) && !std::isnan(xyz.z)) {
       // check if point is inside the grid
       if (isInsideGrid(xyz.x, xyz.y)) {
         // calculate the cell indexes to which the points maps to
         Eigen::Vector2i grid_index = computeGridIndexes(xyz.x, xyz.y);
-        float prev_mean = grid_.getMean(grid_index);
-        float prev_variance = grid_.getVariance(grid_index);
-        grid_.increaseCounter(grid_index);
-        std::pair<float, float> mean_variance = computeOnlineMeanVariance(
-            prev_mean, prev_variance, xyz.z, static_cast<float>(grid_.getCounter(grid_index)));
-        grid_.setMean(grid_index, mean_variance.first);
-        grid_.setVariance(grid_index, mean_variance.second);
-
-        // cloud for visualization of the binning
-        visualization_cloud_.points.push_back(
-            avoidance::toXYZI(xyz, grid_index.x() * (grid_size_ / cell_size_) + grid_index.y()));
+        if (grid_index.x() >= size || grid_index.y() >= size) {
+          continue;  // on the upper limit after rounding
+        }
+        // heights relative to the vehicle keep the sums small
+        int cell = grid_index.x() * size + grid_index.y();
+        double height = static_cast<double>(xyz.z) - position_.z();
+        statistics.count[cell] += 1;
+        statistics.sum[cell] += height;
+        statistics.sum_squares[cell] += height * height;
+
+        if (fill_visualization_cloud_) {
+          visualization_points.push_back(
+              avoidance::toXYZI(xyz, grid_index.x() * (grid_size_ / cell_size_) + grid_index.y()));
+        }
       }
     }
   }
@@ -55,11 +152,11 @@ void SafeLandingPlanner::processRawGrid() {
   grid_seq_ = raw_grid_.header.seq;
   std::swap(previous_grid_, grid_);
   grid_.reset();
-  grid_.setFilterLimits(position_);
 
   if (grid_.getGridSize() != raw_grid_.grid_size || grid_.getCellSize() != raw_grid_.cell_size) {
     grid_.resize(raw_grid_.grid_size, raw_grid_.cell_size);
   }
+  grid_.setGridLimits(Eigen::Vector2f(raw_grid_.grid_min.x, raw_grid_.grid_min.y));
 
   for (int i = 0; i < raw_grid_.mean.layout.dim[0].size; i++) {
     for (int j = 0; j < raw_grid_.mean.layout.dim[1].size; j++) {
@@ -88,62 +185,91 @@ void SafeLandingPlanner::isLandingPossible() {
 
   // if grid smoothing enabled
   if (n_lines_padding_ > 0) {
-    Eigen::MatrixXi land_padded(size + 2 * n_lines_padding_, size + 2 * n_lines_padding_);
-    Eigen::MatrixXi land_accumulator(size + 2 * n_lines_padding_, size + 2 * n_lines_padding_);
-    land_padded.fill(0);
-    land_accumulator.fill(0);
-    Eigen::MatrixXf mean_padded(size + 2 * n_lines_padding_, size + 2 * n_lines_padding_);
-    mean_padded.fill(0.f);
-    Eigen::MatrixXi mean_accumulator(size + 2 * n_lines_padding_, size + 2 * n_lines_padding_);
-    mean_accumulator.fill(0);
+    int window_size = 2 * n_lines_padding_ + 1;
+    int padded_size = size + 2 * n_lines_padding_;
+
+    // summed-area table of grid_.land_, land_sum(i, j) is the number of
+    // landable cells in the rows < i and columns < j
+    Eigen::MatrixXi land_sum = Eigen::MatrixXi::Zero(size + 1, size + 1);
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j < size; j++) {
+        land_sum(i + 1, j + 1) = grid_.land_(i, j) + land_sum(i, j + 1) + land_sum(i + 1, j) - land_sum(i, j);
+      }
+    }
 
-    // copy grid_.land_ into the center of the padded matrix
-    land_padded.block(n_lines_padding_, n_lines_padding_, grid_.land_.rows(), grid_.land_.cols()) = grid_.land_;
+    // cells outside the grid have mean 0
+    Eigen::MatrixXf mean_padded(padded_size, padded_size);
+    mean_padded.fill(0.f);
     mean_padded.block(n_lines_padding_, n_lines_padding_, grid_.mean_.rows(), grid_.mean_.cols()) = grid_.mean_;
 
-    for (int i = n_lines_padding_; i < land_padded.rows() - n_lines_padding_; i++) {
-      for (int j = n_lines_padding_; j < land_padded.cols() - n_lines_padding_; j++) {
-        for (int k = -n_lines_padding_; k <= n_lines_padding_; k++) {
-          for (int t = -n_lines_padding_; t <= n_lines_padding_; t++) {
-            land_accumulator(i, j) += land_padded(i + k, j + t);
-            float mean_diff = std::abs(mean_padded(i, j) - mean_padded(i + k, j + t));
-            if (mean_diff > mean_diff_thr_) {
-              mean_accumulator(i, j) += 1;
-            }
-          }
+    // sorted_rows holds, for each padded row and each grid column j, the means
+    // of the window_size cells of the row around j in ascending order. The
+    // windows slide along the row, so each step removes and inserts one value
+    std::vector<float> sorted_rows(padded_size * size * window_size);
+    std::vector<float> window(window_size);
+    for (int i = 0; i < padded_size; i++) {
+      for (int t = 0; t < window_size; t++) {
+        window[t] = mean_padded(i, t);
+      }
+      std::sort(window.begin(), window.end());
+      for (int j = 0; j < size; j++) {
+        if (j > 0) {
+          window.erase(std::lower_bound(window.begin(), window.end(), mean_padded(i, j - 1)));
+          float entering = mean_padded(i, j + window_size - 1);
+          window.insert(std::upper_bound(window.begin(), window.end(), entering), entering);
         }
+        std::copy(window.begin(), window.end(), sorted_rows.begin() + (i * size + j) * window_size);
       }
     }
 
-    // threshold each cell based on the number of landable cells in the
-    // neighborhood
-    land_accumulator = (land_accumulator.array() <= min_n_land_cells_).select(0, land_accumulator);
-    land_accumulator = (land_accumulator.array() > min_n_land_cells_).select(1, land_accumulator);
-
-    // threshold each cell based on the number of cells in the neighborhood with
-    // mean value difference greater than mean_diff_thr_
-    mean_accumulator = (mean_accumulator.array() <= max_n_mean_diff_cells_).select(1, mean_accumulator);
-    mean_accumulator = (mean_accumulator.array() > max_n_mean_diff_cells_).select(0, mean_accumulator);
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j < size; j++) {
+        // threshold each cell based on the number of landable cells in the
+        // neighborhood, the cells outside the grid are not landable
+        int row_min = std::max(0, i - n_lines_padding_), row_max = std::min(size, i + n_lines_padding_ + 1);
+        int col_min = std::max(0, j - n_lines_padding_), col_max = std::min(size, j + n_lines_padding_ + 1);
+        int n_land_cells = land_sum(row_max, col_max) - land_sum(row_min, col_max) - land_sum(row_max, col_min) +
+                           land_sum(row_min, col_min);
+        bool enough_land_cells = n_land_cells > min_n_land_cells_ || min_n_land_cells_ < 0;
 
-    // logical AND between mean_accumulator and land_accumulator
-    land_accumulator = mean_accumulator.cwiseProduct(land_accumulator);
+        // threshold each cell based on the number of cells in the neighborhood with
+        // mean value difference greater than mean_diff_thr_. As with the earlier
+        // two-step thresholding, no cell passes if max_n_mean_diff_cells_ is 0
+        bool flat_neighborhood = enough_land_cells && max_n_mean_diff_cells_ >= 1;
+        float mean = grid_.mean_(i, j);
+        int n_mean_diff_cells = 0;
+        for (int k = 0; k < window_size && flat_neighborhood; k++) {
+          // in a sorted window the lower means that differ by more than the
+          // threshold are a prefix and the higher ones a suffix
+          auto begin = sorted_rows.begin() + ((i + k) * size + j) * window_size;
+          auto end = begin + window_size;
+          if (!(mean - *begin > mean_diff_thr_) && !(*(end - 1) - mean > mean_diff_thr_)) {
+            continue;  // the lowest and highest means are close enough
+          }
+          auto split = std::upper_bound(begin, end, mean);
+          auto lower_end = std::partition_point(begin, split, [&](float m) { return mean - m > mean_diff_thr_; });
+          auto higher_begin = std::partition_point(split, end, [&](float m) { return !(m - mean > mean_diff_thr_); });
+          n_mean_diff_cells += (lower_end - begin) + (end - higher_begin);
+          flat_neighborhood = n_mean_diff_cells <= max_n_mean_diff_cells_;
+        }
 
-    // copy back into grid.land_
-    grid_.land_.block(0, 0, grid_.land_.rows(), grid_.land_.cols()) =
-        land_accumulator.block(n_lines_padding_, n_lines_padding_, grid_.land_.rows(), grid_.land_.cols());
+        // logical AND between the two thresholds
+        grid_.land_(i, j) = flat_neighborhood ? 1 : 0;
+      }
+    }
   }
   pos_index_ = computeGridIndexes(position_.x(), position_.y());
 }
 
 void SafeLandingPlanner::setPose(const Eigen::Vector3f& pos, const Eigen::Quaternionf& q) { position_ = pos; }
 
-bool SafeLandingPlanner::isInsideGrid(float x, float y) {
+bool SafeLandingPlanner::isInsideGrid(float x, float y) const {
   Eigen::Vector2f grid_min, grid_max;
   grid_.getGridLimits(grid_min, grid_max);
   return x < grid_max.x() && x > grid_min.x() && y < grid_max.y() && y > grid_min.y();
 }
 
-Eigen::Vector2i SafeLandingPlanner::computeGridIndexes(float x, float y) {
+Eigen::Vector2i SafeLandingPlanner::computeGridIndexes(float x, float y) const {
   Eigen::Vector2f grid_min, grid_max;
   grid_.getGridLimits(grid_min, grid_max);
   Eigen::Vector2i idx(static_cast<int>(std::floor((x - grid_min.x()) / grid_.getCellSize())),
@@ -151,26 +277,6 @@ Eigen::Vector2i SafeLandingPlanner::computeGridIndexes(float x, float y) {
   return idx;
 }
 
-std::pair<float, float> SafeLandingPlanner::computeOnlineMeanVariance(float prev_mean, float prev_variance,
-                                                                      float new_value, float seq) {
-  std::pair<float, float> pair(NAN, NAN);
-  pair.first = (prev_mean * (seq - 1) + new_value) / (seq);
-
-  // Welford's algorithm
-  // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
-  float delta = new_value - prev_mean;
-  float delta2 = new_value - pair.first;
-  float prev_M2 = 0;
-  if ((seq - 1) >= 0) {
-    prev_M2 = prev_variance * (seq - 1);
-  }
-  float M2 = prev_M2 + delta * delta2;
-  if (seq > 0) {
-    pair.second = M2 / seq;
-  }
-  return pair;
-}
-
 // set parameters changed by dynamic rconfigure
 void SafeLandingPlanner::dynamicReconfigureSetParams(const safe_landing_planner::SafeLandingPlannerNodeConfig& config,
                                                      uint32_t level) {
@@ -187,8 +293,9 @@ void SafeLandingPlanner::dynamicReconfigureSetParams(const safe_landing_planner:
   timeout_termination_ = config.timeout_termination;
   min_n_land_cells_ = config.min_n_land_cells;
   if ((grid_.getGridSize() != grid_size_) || (grid_.getCellSize() != cell_size_) ||
-      (n_lines_padding_ != smoothing_size_)) {
+      (n_lines_padding_ != smoothing_size_) || (use_rolling_grid_ != config.rolling_grid)) {
     size_update_ = true;
   }
+  use_rolling_grid_ = config.rolling_grid;
 }
 }
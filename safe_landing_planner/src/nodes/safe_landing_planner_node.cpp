@@ -1,9 +1,32 @@
 #include "safe_landing_planner/safe_landing_planner_node.hpp"
 
+#include <type_traits>
+
 namespace avoidance {
 
 const Eigen::Vector3f nan_setpoint = Eigen::Vector3f(NAN, NAN, NAN);
 
+namespace {
+// stores the matrix in the multiarray row by row, element (i, j) is at i * cols + j
+template <typename Derived, typename MultiArray>
+void toRowMajorArray(const Eigen::MatrixBase<Derived> &matrix, MultiArray &array) {
+  typedef typename std::decay<decltype(array.data[0])>::type Scalar;
+  int rows = matrix.rows();
+  int cols = matrix.cols();
+  array.layout.dim.resize(2);
+  array.layout.dim[0].label = "height";
+  array.layout.dim[0].size = rows;
+  array.layout.dim[0].stride = rows * cols;
+  array.layout.dim[1].label = "width";
+  array.layout.dim[1].size = cols;
+  array.layout.dim[1].stride = cols;
+  array.layout.data_offset = 0;
+  array.data.resize(rows * cols);
+  Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(array.data.data(), rows, cols) =
+      matrix.template cast<Scalar>();
+}
+}
+
 SafeLandingPlannerNode::SafeLandingPlannerNode(const ros::NodeHandle &nh) : nh_(nh), spin_dt_(0.1) {
   safe_landing_planner_.reset(new SafeLandingPlanner());
 
@@ -15,6 +38,7 @@ SafeLandingPlannerNode::SafeLandingPlannerNode(const ros::NodeHandle &nh) : nh_(
   std::string camera_topic;
   nh_.getParam("pointcloud_topics", camera_topic);
   nh_.param<bool>("play_rosbag", safe_landing_planner_->play_rosbag_, false);
+  nh_.param<int>("threads", safe_landing_planner_->n_threads_, 0);
 
   dynamic_reconfigure::Server<safe_landing_planner::SafeLandingPlannerNodeConfig>::CallbackType f;
   f = boost::bind(&SafeLandingPlannerNode::dynamicReconfigureCallback, this, _1, _2);
@@ -103,6 +127,7 @@ void SafeLandingPlannerNode::cmdLoopCallback(const ros::TimerEvent &event) {
   {
     std::lock_guard<std::mutex> transformed_cloud_guard(*(transformed_cloud_mutex_));
 
+    safe_landing_planner_->fill_visualization_cloud_ = visualizer_.isPointcloudSubscribed();
     safe_landing_planner_->runSafeLandingPlanner();
     cloud_transformed_ = false;
   }
@@ -136,71 +161,28 @@ void SafeLandingPlannerNode::publishSystemStatus() {
 
 void SafeLandingPlannerNode::publishSerialGrid() {
   static int grid_seq = 0;
-  Grid prev_grid = safe_landing_planner_->getPreviousGrid();
-  safe_landing_planner::SLPGridMsg grid;
-  grid.header.frame_id = "local_origin";
-  grid.header.seq = grid_seq;
-  grid.grid_size = prev_grid.getGridSize();
-  grid.cell_size = prev_grid.getCellSize();
-
-  grid.mean.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.mean.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.mean.layout.dim[0].label = "height";
-  grid.mean.layout.dim[0].size = prev_grid.mean_.cols();
-  grid.mean.layout.dim[0].stride = prev_grid.mean_.rows() * prev_grid.mean_.cols();
-
-  grid.mean.layout.dim[1].label = "width";
-  grid.mean.layout.dim[1].size = prev_grid.mean_.rows();
-  grid.mean.layout.dim[1].stride = prev_grid.mean_.rows();
-  grid.mean.layout.data_offset = 0;
-
-  grid.land.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.land.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.land.layout.dim[0].label = "height";
-  grid.land.layout.dim[0].size = prev_grid.land_.cols();
-  grid.land.layout.dim[0].stride = prev_grid.land_.rows() * prev_grid.land_.cols();
-
-  grid.land.layout.dim[1].label = "width";
-  grid.land.layout.dim[1].size = prev_grid.land_.rows();
-  grid.land.layout.dim[1].stride = prev_grid.land_.rows();
-  grid.land.layout.data_offset = 0;
-
-  Eigen::MatrixXf variance = prev_grid.getVariance();
-  grid.std_dev.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.std_dev.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.std_dev.layout.dim[0].label = "height";
-  grid.std_dev.layout.dim[0].size = variance.cols();
-  grid.std_dev.layout.dim[0].stride = variance.rows() * variance.cols();
-
-  grid.std_dev.layout.dim[1].label = "width";
-  grid.std_dev.layout.dim[1].size = variance.rows();
-  grid.std_dev.layout.dim[1].stride = variance.rows();
-  grid.std_dev.layout.data_offset = 0;
-
-  Eigen::MatrixXi counter = prev_grid.getCounter();
-  grid.counter.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.counter.layout.dim.push_back(std_msgs::MultiArrayDimension());
-  grid.counter.layout.dim[0].label = "height";
-  grid.counter.layout.dim[0].size = counter.cols();
-  grid.counter.layout.dim[0].stride = counter.rows() * counter.cols();
-
-  grid.counter.layout.dim[1].label = "width";
-  grid.counter.layout.dim[1].size = counter.rows();
-  grid.counter.layout.dim[1].stride = counter.rows();
-  grid.counter.layout.data_offset = 0;
-
-  for (size_t i = 0; i < prev_grid.getRowColSize(); i++) {
-    for (size_t j = 0; j < prev_grid.getRowColSize(); j++) {
-      grid.mean.data.push_back(prev_grid.mean_(i, j));
-      grid.land.data.push_back(prev_grid.land_(i, j));
-      grid.std_dev.data.push_back(sqrtf(variance(i, j)));
-      grid.counter.data.push_back(counter(i, j));
-    }
-  }
-  Eigen::Vector2i pos_index = safe_landing_planner_->getPositionIndex();
-  grid.curr_pos_index.x = static_cast<float>(pos_index.x());
-  grid.curr_pos_index.y = static_cast<float>(pos_index.y());
+  const Grid &prev_grid = safe_landing_planner_->getPreviousGrid();
+  safe_landing_planner::SLPGridMsgPtr grid = boost::make_shared<safe_landing_planner::SLPGridMsg>();
+  grid->header.frame_id = "local_origin";
+  grid->header.seq = grid_seq;
+  grid->grid_size = prev_grid.getGridSize();
+  grid->cell_size = prev_grid.getCellSize();
+
+  // filled straight from the matrices, the standard deviation in one vectorized pass
+  toRowMajorArray(prev_grid.mean_, grid->mean);
+  toRowMajorArray(prev_grid.land_, grid->land);
+  toRowMajorArray(prev_grid.getVariance().cwiseSqrt(), grid->std_dev);
+  toRowMajorArray(prev_grid.getCounter(), grid->counter);
 
+  Eigen::Vector2i pos_index = safe_landing_planner_->getPositionIndex();
+  grid->curr_pos_index.x = static_cast<float>(pos_index.x());
+  grid->curr_pos_index.y = static_cast<float>(pos_index.y());
+  Eigen::Vector2f grid_min, grid_max;
+  prev_grid.getGridLimits(grid_min, grid_max);
+  grid->grid_min.x = grid_min.x();
+  grid->grid_min.y = grid_min.y();
+
+  // publishing the pointer lets subscribers in the same process share the message
   grid_pub_.publish(grid);
   grid_seq++;
 }
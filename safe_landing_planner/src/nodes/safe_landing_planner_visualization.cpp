@@ -18,7 +18,9 @@ void SafeLandingPlannerVisualization::initializePublishers(ros::NodeHandle& nh)
 void SafeLandingPlannerVisualization::visualizeSafeLandingPlanner(
     const SafeLandingPlanner& planner, const geometry_msgs::Point& pos, const geometry_msgs::Point& last_pos,
     safe_landing_planner::SafeLandingPlannerNodeConfig& config) {
-  local_pointcloud_pub_.publish(planner.visualization_cloud_);
+  if (planner.fill_visualization_cloud_) {
+    local_pointcloud_pub_.publish(planner.visualization_cloud_);
+  }
   publishGrid(planner.getGrid(), pos, planner.getSmoothingSize());
   publishMeanStdDev(planner.getGrid(), static_cast<float>(config.std_dev_threshold));
   publishCounter(planner.getGrid(), static_cast<float>(config.n_points_threshold));
@@ -53,8 +55,8 @@ void SafeLandingPlannerVisualization::publishMeanStdDev(const Grid& grid, float
   float range_max = 360.f;
   float range_min = 0.f;
 
-  Eigen::MatrixXf mean = grid.getMean();
-  Eigen::MatrixXf variance = grid.getVariance();
+  Grid::ConstFloatView mean = grid.getMean();
+  Grid::ConstFloatView variance = grid.getVariance();
 
   for (size_t i = 0; i < grid.getRowColSize(); i++) {
     for (size_t j = 0; j < grid.getRowColSize(); j++) {
@@ -147,7 +149,7 @@ void SafeLandingPlannerVisualization::publishCounter(const Grid& grid, float n_p
   Eigen::Vector2f grid_min, grid_max;
   grid.getGridLimits(grid_min, grid_max);
 
-  Eigen::MatrixXi counter = grid.getCounter();
+  Grid::ConstIntView counter = grid.getCounter();
 
   float counter_max_value = 400.0f;
   float counter_min_value = n_points_threshold;
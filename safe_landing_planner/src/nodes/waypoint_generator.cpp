@@ -293,10 +293,8 @@ usm::Transition WaypointGenerator::runEvaluateGrid() {
         Eigen::Vector2f min, max;
 
         grid_slp_.getGridLimits(min, max);
-        goal_ = Eigen::Vector3f(
-            position_.x() + (offset.x() + smoothing_land_cell_ - grid_slp_.land_.rows() / 2) * grid_slp_.getCellSize(),
-            position_.y() + (offset.y() + smoothing_land_cell_ - grid_slp_.land_.cols() / 2) * grid_slp_.getCellSize(),
-            position_.z());
+        goal_ = Eigen::Vector3f(min.x() + (offset.x() + smoothing_land_cell_) * grid_slp_.getCellSize(),
+                                min.y() + (offset.y() + smoothing_land_cell_) * grid_slp_.getCellSize(), position_.z());
 
         velocity_setpoint_.z() = NAN;
         ROS_INFO("\033[1;31m [WGN] Found landing area in grid at %f %f %f \033[0m", goal_.x(), goal_.y(), goal_.z());
@@ -124,7 +124,8 @@ void WaypointGeneratorNode::gridCallback(const safe_landing_planner::SLPGridMsg
   waypointGenerator_.pos_index_.x() = static_cast<int>(msg.curr_pos_index.x);
   waypointGenerator_.pos_index_.y() = static_cast<int>(msg.curr_pos_index.y);
 
-  waypointGenerator_.grid_slp_.setFilterLimits(waypointGenerator_.position_);
+  // the grid is centered on the vehicle only if the planner does not anchor it to the ground
+  waypointGenerator_.grid_slp_.setGridLimits(Eigen::Vector2f(msg.grid_min.x, msg.grid_min.y));
   grid_received_ = true;
 }
 
@@ -29,3 +29,108 @@ TEST(GridTest, gridCellSize2) {
   EXPECT_FLOAT_EQ(2.8f, limit_max.x());
   EXPECT_FLOAT_EQ(11.4f, limit_max.y());
 }
+
+TEST(GridTest, gridLimitsCoverWholeCells) {
+  // GIVEN: a grid whose size is not a multiple of the cell size, resized from a smaller one
+  Grid grid = Grid(6.f, 2.f);
+  grid.resize(10.f, 3.f);
+  Eigen::Vector3f pos(1.2f, 3.4f, 2.f);
+
+  // WHEN: the limits are anchored, or set from the lower corner
+  grid.setAnchoredFilterLimits(pos);
+  Eigen::Vector2f anchored_min, anchored_max;
+  grid.getGridLimits(anchored_min, anchored_max);
+  grid.setGridLimits(anchored_min);
+  Eigen::Vector2f limit_min, limit_max;
+  grid.getGridLimits(limit_min, limit_max);
+
+  // THEN: both span the 4 cells of the resized grid
+  EXPECT_EQ(4, grid.getRowColSize());
+  EXPECT_FLOAT_EQ(anchored_min.x() + 12.f, anchored_max.x());
+  EXPECT_FLOAT_EQ(anchored_max.x(), limit_max.x());
+  EXPECT_FLOAT_EQ(anchored_max.y(), limit_max.y());
+}
+
+// fills every cell with values that depend on its index and on offset
+void fillGrid(Grid &grid, int offset) {
+  for (int i = 0; i < grid.getRowColSize(); i++) {
+    for (int j = 0; j < grid.getRowColSize(); j++) {
+      Eigen::Vector2i idx(i, j);
+      grid.setMean(idx, offset + i + 0.5f * j);
+      grid.setVariance(idx, offset + 2.f * i + j);
+      grid.setCounter(idx, offset + 3 * i + j);
+      grid.land_(i, j) = offset + i + 4 * j;
+    }
+  }
+}
+
+void expectGrid(const Grid &grid, int row_col_size, int offset) {
+  ASSERT_EQ(row_col_size, grid.getRowColSize());
+  for (int i = 0; i < grid.getRowColSize(); i++) {
+    for (int j = 0; j < grid.getRowColSize(); j++) {
+      Eigen::Vector2i idx(i, j);
+      EXPECT_FLOAT_EQ(offset + i + 0.5f * j, grid.getMean(idx));
+      EXPECT_FLOAT_EQ(offset + 2.f * i + j, grid.getVariance(idx));
+      EXPECT_EQ(offset + 3 * i + j, grid.getCounter(idx));
+      EXPECT_EQ(offset + i + 4 * j, grid.land_(i, j));
+    }
+  }
+}
+
+TEST(GridTest, copyKeepsValuesOfSource) {
+  // GIVEN: a grid with values
+  Grid source(6.f, 2.f);
+  fillGrid(source, 1);
+
+  // WHEN: we copy construct and copy assign it, then change the source
+  Grid constructed(source);
+  Grid assigned(4.f, 1.f);
+  assigned = source;
+  fillGrid(source, 10);
+  source.reset();
+
+  // THEN: the copies keep the values they copied
+  expectGrid(constructed, 3, 1);
+  expectGrid(assigned, 3, 1);
+}
+
+TEST(GridTest, moveKeepsValuesOfSource) {
+  // GIVEN: two grids with values
+  Grid *source = new Grid(6.f, 2.f);
+  fillGrid(*source, 1);
+  Grid *other = new Grid(4.f, 1.f);
+  fillGrid(*other, 20);
+
+  // WHEN: we move construct from one and move assign from the other, then change and destroy the sources
+  Grid constructed(std::move(*source));
+  Grid assigned(8.f, 2.f);
+  assigned = std::move(*other);
+  fillGrid(*source, 10);
+  fillGrid(*other, 30);
+  delete source;
+  delete other;
+
+  // THEN: the targets have the values of the sources before the move
+  expectGrid(constructed, 3, 1);
+  expectGrid(assigned, 4, 20);
+}
+
+TEST(GridTest, swapExchangesValues) {
+  // GIVEN: two grids of different sizes
+  Grid *first = new Grid(6.f, 2.f);
+  fillGrid(*first, 1);
+  Grid second(4.f, 1.f);
+  fillGrid(second, 20);
+
+  // WHEN: we swap them, like the planner swaps the current and previous grid
+  std::swap(*first, second);
+
+  // THEN: each has the values of the other
+  expectGrid(*first, 4, 20);
+  expectGrid(second, 3, 1);
+
+  // AND: changing and destroying one doesn't change the other
+  fillGrid(*first, 40);
+  delete first;
+  expectGrid(second, 3, 1);
+}
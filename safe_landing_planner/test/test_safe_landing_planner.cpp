@@ -20,6 +20,40 @@ class TestSafeLanding : public ::SafeLandingPlanner {
   float& test_getCounterThreshold() { return n_points_thr_; }
 };
 
+// Landability of each cell computed with the direct neighborhood loops
+Eigen::MatrixXi bruteForceLand(const Grid& grid, const safe_landing_planner::SafeLandingPlannerNodeConfig& config) {
+  int size = grid.getRowColSize();
+  int padding = config.smoothing_size;
+  Eigen::MatrixXf mean = grid.getMean();
+  Eigen::MatrixXf variance = grid.getVariance();
+  Eigen::MatrixXi counter = grid.getCounter();
+  Eigen::MatrixXi land(size, size);
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j < size; j++) {
+      land(i, j) = counter(i, j) >= config.n_points_threshold && sqrtf(variance(i, j)) <= config.std_dev_threshold;
+    }
+  }
+  Eigen::MatrixXi result(size, size);
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j < size; j++) {
+      int n_land = 0, n_mean_diff = 0;
+      for (int k = i - padding; k <= i + padding; k++) {
+        for (int t = j - padding; t <= j + padding; t++) {
+          bool inside = k >= 0 && k < size && t >= 0 && t < size;
+          n_land += inside ? land(k, t) : 0;
+          float neighbor_mean = inside ? mean(k, t) : 0.f;
+          n_mean_diff += std::abs(mean(i, j) - neighbor_mean) > static_cast<float>(config.mean_diff_thr);
+        }
+      }
+      int land_flag = n_land > config.min_n_land_cells ? 1 : 0;
+      int mean_flag = n_mean_diff <= config.max_n_mean_diff_cells ? 1 : n_mean_diff;
+      mean_flag = mean_flag > config.max_n_mean_diff_cells ? 0 : mean_flag;
+      result(i, j) = land_flag * mean_flag;
+    }
+  }
+  return result;
+}
+
 class SafeLandingPlannerTests : public ::testing::Test {
  public:
   TestSafeLanding safe_landing_planner;
@@ -357,3 +391,149 @@ TEST_F(SafeLandingPlannerTests, test_combine) {
   ASSERT_NEAR(0.9f * 5.15f + 0.1f * 3.21f, safe_landing_planner.test_getGrid().getMean(y), 0.001f);
   ASSERT_NEAR(0.9f * 1.89f + 0.1f * 1.75f, safe_landing_planner.test_getGrid().getMean(z), 0.001f);
 }
+
+TEST_F(SafeLandingPlannerTests, land_matches_brute_force) {
+  safe_landing_planner::SafeLandingPlannerNodeConfig config =
+      safe_landing_planner::SafeLandingPlannerNodeConfig::__getDefault__();
+  config.cell_size = 0.25;
+  config.alpha = 0.0;
+  config.n_points_threshold = 2;
+  config.std_dev_threshold = 0.3;
+
+  std::default_random_engine generator(seed);
+  std::normal_distribution<float> distribution_mean(0.5f, 0.2f);
+  std::uniform_real_distribution<float> distribution_variance(0.f, 0.15f);
+  std::uniform_int_distribution<int> distribution_counter(0, 5);
+
+  for (int smoothing_size : {1, 2, 5}) {
+    for (int max_n_mean_diff_cells : {0, 1, 6, 70}) {
+      for (int min_n_land_cells : {0, 5, 40}) {
+        for (double mean_diff_thr : {0.0, 0.1, 0.25}) {
+          config.smoothing_size = smoothing_size;
+          config.max_n_mean_diff_cells = max_n_mean_diff_cells;
+          config.min_n_land_cells = min_n_land_cells;
+          config.mean_diff_thr = mean_diff_thr;
+          safe_landing_planner.dynamicReconfigureSetParams(config, 1);
+          safe_landing_planner.runSafeLandingPlanner();  // applies the new size and smoothing
+
+          // means on a 5 cm raster, so many differences are right at the threshold
+          Grid& grid = safe_landing_planner.test_getGrid();
+          for (int i = 0; i < grid.getRowColSize(); i++) {
+            for (int j = 0; j < grid.getRowColSize(); j++) {
+              Eigen::Vector2i idx(i, j);
+              grid.setMean(idx, std::round(distribution_mean(generator) * 20.f) / 20.f);
+              grid.setVariance(idx, distribution_variance(generator));
+              grid.setCounter(idx, distribution_counter(generator));
+            }
+          }
+          safe_landing_planner.isLandingPossible();
+
+          Eigen::MatrixXi expected = bruteForceLand(grid, config);
+          ASSERT_TRUE(expected == grid.land_) << "smoothing_size " << smoothing_size << " max_n_mean_diff_cells "
+                                              << max_n_mean_diff_cells << " min_n_land_cells " << min_n_land_cells
+                                              << " mean_diff_thr " << mean_diff_thr;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SafeLandingPlannerTests, parallel_binning) {
+  safe_landing_planner::SafeLandingPlannerNodeConfig config =
+      safe_landing_planner::SafeLandingPlannerNodeConfig::__getDefault__();
+  config.cell_size = 0.5;
+  config.alpha = 0.0;
+  safe_landing_planner.dynamicReconfigureSetParams(config, 1);
+
+  Eigen::Vector3f pos(5.f, 5.f, 5.f);
+  safe_landing_planner.setPose(pos, q);
+
+  // enough points to be binned in several chunks
+  std::default_random_engine generator(seed);
+  std::uniform_real_distribution<float> distribution_xy(0.f, 10.f);
+  std::normal_distribution<float> distribution_z(0.3f, 0.1f);
+  for (int i = 0; i < 100000; ++i) {
+    safe_landing_planner.cloud_.push_back(
+        pcl::PointXYZ(distribution_xy(generator), distribution_xy(generator), distribution_z(generator)));
+  }
+
+  safe_landing_planner.n_threads_ = 1;
+  safe_landing_planner.runSafeLandingPlanner();
+  Grid serial_grid = safe_landing_planner.test_getGrid();
+  size_t n_visualization_points = safe_landing_planner.visualization_cloud_.points.size();
+
+  safe_landing_planner.n_threads_ = 4;
+  safe_landing_planner.fill_visualization_cloud_ = false;
+  safe_landing_planner.runSafeLandingPlanner();
+  Grid& grid = safe_landing_planner.test_getGrid();
+
+  EXPECT_EQ(100000u, n_visualization_points);
+  EXPECT_TRUE(safe_landing_planner.visualization_cloud_.points.empty());
+  ASSERT_TRUE(serial_grid.getCounter() == grid.getCounter());
+  for (int i = 0; i < grid.getRowColSize(); i++) {
+    for (int j = 0; j < grid.getRowColSize(); j++) {
+      Eigen::Vector2i idx(i, j);
+      ASSERT_NEAR(serial_grid.getMean(idx), grid.getMean(idx), 1e-5f);
+      ASSERT_NEAR(serial_grid.getVariance(idx), grid.getVariance(idx), 1e-5f);
+    }
+  }
+}
+
+TEST_F(SafeLandingPlannerTests, rolling_grid) {
+  safe_landing_planner::SafeLandingPlannerNodeConfig config =
+      safe_landing_planner::SafeLandingPlannerNodeConfig::__getDefault__();
+  config.grid_size = 10;
+  config.cell_size = 1;
+  config.alpha = 0.5;
+  config.rolling_grid = true;
+  safe_landing_planner.dynamicReconfigureSetParams(config, 1);
+
+  // four points in each cell of the ground under the grid
+  auto add_ground = [&](float min_x, float max_x, float height_left, float height_right) {
+    safe_landing_planner.cloud_.clear();
+    for (float x = min_x + 0.25f; x < max_x; x += 0.5f) {
+      for (float y = 0.25f; y < 10.f; y += 0.5f) {
+        safe_landing_planner.cloud_.push_back(pcl::PointXYZ(x, y, x < 5.f ? height_left : height_right));
+      }
+    }
+  };
+
+  Eigen::Vector3f pos(5.f, 5.f, 5.f);
+  safe_landing_planner.setPose(pos, q);
+  add_ground(0.f, 10.f, 1.f, 2.f);
+  safe_landing_planner.runSafeLandingPlanner();
+
+  // the vehicle moves by two cells, the grid keeps the ground at x = 6 in its cell
+  pos.x() = 7.3f;
+  safe_landing_planner.setPose(pos, q);
+  add_ground(2.f, 12.f, 1.5f, 1.5f);
+  safe_landing_planner.runSafeLandingPlanner();
+  Grid& grid = safe_landing_planner.test_getGrid();
+
+  Eigen::Vector2f grid_min, grid_max;
+  grid.getGridLimits(grid_min, grid_max);
+  EXPECT_FLOAT_EQ(2.f, grid_min.x());
+  EXPECT_FLOAT_EQ(0.f, grid_min.y());
+
+  // seen in both frames, the first one with weight alpha
+  Eigen::Vector2i seen_twice(4, 5);
+  EXPECT_NEAR((0.5f * 2.f + 1.5f) / 1.5f, grid.getMean(seen_twice), 1e-5f);
+  EXPECT_NEAR(0.5f * 0.5f * 0.5f / (1.5f * 1.5f), grid.getVariance(seen_twice), 1e-5f);
+  EXPECT_EQ(4, grid.getCounter(seen_twice));
+
+  // entered the grid in the second frame
+  Eigen::Vector2i seen_once(9, 5);
+  EXPECT_FLOAT_EQ(1.5f, grid.getMean(seen_once));
+  EXPECT_FLOAT_EQ(0.f, grid.getVariance(seen_once));
+  EXPECT_EQ(4, grid.getCounter(seen_once));
+
+  // switching the rolling grid off and on again drops the history
+  config.rolling_grid = false;
+  safe_landing_planner.dynamicReconfigureSetParams(config, 1);
+  safe_landing_planner.runSafeLandingPlanner();
+  config.rolling_grid = true;
+  safe_landing_planner.dynamicReconfigureSetParams(config, 1);
+  safe_landing_planner.cloud_.clear();
+  safe_landing_planner.runSafeLandingPlanner();
+  EXPECT_EQ(0, safe_landing_planner.test_getGrid().getCounter().sum());
+}
@@ -210,6 +210,36 @@ TEST_F(WaypointGeneratorTests, evaluateGrid_to_goToLand_with_full_grid_eval) {
   ASSERT_EQ(Eigen::Vector2f(published_position.x() - position_.x(), published_position.y() - position_.y()).norm(), 0);
 }
 
+TEST_F(WaypointGeneratorTests, evaluateGrid_landing_area_in_anchored_grid) {
+  // GIVEN: a grid anchored to the ground, the vehicle is not at the center of its cells
+  position_ << 10.4, 10.7, 4.5;
+  goal_ << 10.4, 10.7, 0;
+  is_land_waypoint_ = true;
+  grid_slp_.setAnchoredFilterLimits(position_);
+  Eigen::Vector2f grid_min, grid_max;
+  grid_slp_.getGridLimits(grid_min, grid_max);
+  ASSERT_FLOAT_EQ(-10.f, grid_min.x());
+  ASSERT_FLOAT_EQ(-10.f, grid_min.y());
+
+  calculateWaypoint();
+  ASSERT_EQ(SLPState::ALTITUDE_CHANGE, getState());
+  calculateWaypoint();
+  ASSERT_EQ(SLPState::LOITER, getState());
+  grid_slp_seq_ = 25;
+  calculateWaypoint();
+  ASSERT_EQ(SLPState::EVALUATE_GRID, getState());
+
+  // WHEN: the only landing area is the top left quarter of the grid
+  can_land_hysteresis_result_.fill(0);
+  can_land_hysteresis_result_.topLeftCorner(20, 20) = Eigen::MatrixXi::Ones(20, 20);
+  calculateWaypoint();
+
+  // THEN: the goal is the center cell of the first patch that fits, (13, 13), in the cells of the grid
+  ASSERT_EQ(SLPState::GOTO_LAND, getState());
+  EXPECT_FLOAT_EQ(grid_min.x() + 13.f, goal_.x());
+  EXPECT_FLOAT_EQ(grid_min.y() + 13.f, goal_.y());
+}
+
 TEST_F(WaypointGeneratorTests, evaluateGrid_to_goTo) {
   // GIVEN: a basic waypoint generator, that switched to altitude change after
   // first iteration